@@ -0,0 +1,512 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+// Headless batch renderer, renders every file of a job with every camera
+// preset and every field into PNG images. Where EGL is available the OpenGL
+// context needs no display server, otherwise a hidden GLFW window provides
+// it, which needs an X11 or Wayland display.
+//
+// usage: gui-batch job.txt
+//
+// The job file holds one directive per line, # starts a comment:
+//
+//   file <path>                  CGNS file, repeated
+//   view <name> <yaw> <pitch>    camera preset in degrees, repeated
+//   field <name>                 field coloring the cut plane, repeated
+//   plane <nx> <ny> <nz>         cut plane normal, through the center
+//   size <width> <height>        image size in pixels
+//   output <directory>           image directory
+//
+// Images are written as <output>/<file stem>_<view>_<field>.png. The next
+// file is read, converted and cut on the pool while the current one renders.
+
+#include "include/camera.hpp"
+#include "include/cutPlane.hpp"
+#include "include/data.hpp"
+#include "include/frameBuffer.hpp"
+#include "include/frameCapture.hpp"
+#include "include/log.hpp"
+#include "include/parallel.hpp"
+#include "include/shaderRegistry.hpp"
+#include "include/triangleBuffer.hpp"
+#include "include/uniformBuffer.hpp"
+#include <glad/glad.h>
+
+#ifdef GUI_BATCH_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <initializer_list>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using namespace cgns_tools::gui;
+
+struct view
+{
+  std::string name;
+  float yaw = 0.0f;
+  float pitch = 0.0f;
+};
+
+struct job
+{
+  std::vector<std::string> files;
+  std::vector<view> views;
+  std::vector<std::string> fields;
+  glm::vec3 normal{ 1.0f, 0.0f, 0.0f };
+  int32_t width = 1920;
+  int32_t height = 1080;
+  std::filesystem::path output = ".";
+};
+
+std::optional<job>
+read_job(const std::filesystem::path& path)
+{
+  std::ifstream file{ path };
+  if (!file)
+  {
+    std::fprintf(stderr, "Failed to open job file %s\n", path.c_str());
+    return std::nullopt;
+  }
+
+  job result;
+  std::string line;
+  for (std::size_t lineNumber = 1; std::getline(file, line); ++lineNumber)
+  {
+    std::istringstream in{ line.substr(0, line.find('#')) };
+    std::string directive;
+    if (!(in >> directive))
+    {
+      continue;
+    }
+
+    bool ok = true;
+    if (directive == "file")
+    {
+      ok = bool(in >> result.files.emplace_back());
+    }
+    else if (directive == "view")
+    {
+      auto& v = result.views.emplace_back();
+      ok = bool(in >> v.name >> v.yaw >> v.pitch);
+    }
+    else if (directive == "field")
+    {
+      ok = bool(in >> result.fields.emplace_back());
+    }
+    else if (directive == "plane")
+    {
+      ok = bool(in >> result.normal.x >> result.normal.y >> result.normal.z);
+    }
+    else if (directive == "size")
+    {
+      ok = bool(in >> result.width >> result.height) && result.width > 0 &&
+           result.height > 0;
+    }
+    else if (directive == "output")
+    {
+      std::string output;
+      ok = bool(in >> output);
+      result.output = output;
+    }
+    else
+    {
+      ok = false;
+    }
+
+    if (!ok)
+    {
+      std::fprintf(stderr,
+                   "%s:%zu: invalid directive '%s'\n",
+                   path.c_str(),
+                   lineNumber,
+                   line.c_str());
+      return std::nullopt;
+    }
+  }
+
+  if (result.views.empty())
+  {
+    result.views.push_back({ "default", 30.0f, 20.0f });
+  }
+  if (result.fields.empty())
+  {
+    // color by zone
+    result.fields.emplace_back();
+  }
+  result.normal = glm::normalize(result.normal);
+
+  return result;
+}
+
+/// everything of one file that can be computed without OpenGL
+struct preparedFile
+{
+  meshFile file;
+  aabb bounds;
+  /// one cut plane per job field
+  std::vector<cutPlaneResult> planes;
+};
+
+preparedFile
+prepare(const std::string& path, const job& j)
+{
+  preparedFile result{ read_mesh_file(path), {}, {} };
+
+  for (const auto& zone : *result.file.zones)
+  {
+    result.bounds.extend(zone.bounds);
+  }
+
+  for (const auto& field : j.fields)
+  {
+    cutPlaneSettings settings;
+    settings.cut.origin = result.bounds.center();
+    settings.cut.normal = j.normal;
+    settings.field = field;
+    result.planes.emplace_back(extract_cut_plane(*result.file.zones, settings));
+  }
+
+  return result;
+}
+
+#ifdef GUI_BATCH_EGL
+
+/// display of the first EGL device, rendering without a display server, or
+/// the default display if the device platform is not supported
+EGLDisplay
+device_display()
+{
+  const auto queryDevices =
+    (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+  const auto platformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+    eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (queryDevices && platformDisplay)
+  {
+    EGLDeviceEXT device;
+    EGLint nDevices = 0;
+    if (queryDevices(1, &device, &nDevices) && nDevices > 0)
+    {
+      const auto display =
+        platformDisplay(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+      if (display != EGL_NO_DISPLAY)
+      {
+        return display;
+      }
+    }
+  }
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+/// OpenGL 3.3 core context without a window, current while it lives
+///
+/// Rendering goes to a frameBuffer, the context uses a small pbuffer surface
+/// or no surface at all where pbuffers are not supported.
+struct offscreenContext
+{
+  offscreenContext()
+  {
+    _display = device_display();
+    if (_display == EGL_NO_DISPLAY ||
+        !eglInitialize(_display, nullptr, nullptr))
+    {
+      _display = EGL_NO_DISPLAY;
+      return;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+      return;
+    }
+
+    // prefer configs supporting pbuffers, then any for a surfaceless context
+    EGLConfig config;
+    EGLint nConfigs = 0;
+    for (const EGLint surfaceType : { EGL_PBUFFER_BIT, 0 })
+    {
+      const EGLint configAttributes[] = { EGL_SURFACE_TYPE,
+                                          surfaceType,
+                                          EGL_RENDERABLE_TYPE,
+                                          EGL_OPENGL_BIT,
+                                          EGL_NONE };
+      if (eglChooseConfig(_display, configAttributes, &config, 1, &nConfigs) &&
+          nConfigs > 0)
+      {
+        break;
+      }
+    }
+    if (nConfigs == 0)
+    {
+      return;
+    }
+
+    const EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION,
+                                         3,
+                                         EGL_CONTEXT_MINOR_VERSION,
+                                         3,
+                                         EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                         EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                         EGL_NONE };
+    _context =
+      eglCreateContext(_display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (_context == EGL_NO_CONTEXT)
+    {
+      return;
+    }
+
+    const EGLint pbufferAttributes[] = {
+      EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE
+    };
+    _surface = eglCreatePbufferSurface(_display, config, pbufferAttributes);
+    _current = eglMakeCurrent(_display, _surface, _surface, _context);
+  }
+
+  ~offscreenContext()
+  {
+    if (_display == EGL_NO_DISPLAY)
+    {
+      return;
+    }
+    eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (_surface != EGL_NO_SURFACE)
+    {
+      eglDestroySurface(_display, _surface);
+    }
+    if (_context != EGL_NO_CONTEXT)
+    {
+      eglDestroyContext(_display, _context);
+    }
+    eglTerminate(_display);
+  }
+
+  offscreenContext(const offscreenContext&) = delete;
+  offscreenContext& operator=(const offscreenContext&) = delete;
+
+  bool valid() const { return _current; }
+
+  static GLADloadproc loader() { return (GLADloadproc)eglGetProcAddress; }
+
+private:
+  EGLDisplay _display = EGL_NO_DISPLAY;
+  EGLContext _context = EGL_NO_CONTEXT;
+  EGLSurface _surface = EGL_NO_SURFACE;
+  bool _current = false;
+};
+
+#else
+
+/// OpenGL 3.3 core context of a hidden window, current while it lives
+///
+/// Needs an X11 or Wayland display even though nothing is shown.
+struct offscreenContext
+{
+  offscreenContext()
+  {
+    if (!glfwInit())
+    {
+      return;
+    }
+    _initialized = true;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#if defined(__APPLE__)
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    _window = glfwCreateWindow(16, 16, "gui-batch", NULL, NULL);
+    if (_window != NULL)
+    {
+      glfwMakeContextCurrent(_window);
+    }
+  }
+
+  ~offscreenContext()
+  {
+    if (_window != NULL)
+    {
+      glfwDestroyWindow(_window);
+    }
+    if (_initialized)
+    {
+      glfwTerminate();
+    }
+  }
+
+  offscreenContext(const offscreenContext&) = delete;
+  offscreenContext& operator=(const offscreenContext&) = delete;
+
+  bool valid() const { return _window != NULL; }
+
+  static GLADloadproc loader() { return (GLADloadproc)glfwGetProcAddress; }
+
+private:
+  bool _initialized = false;
+  GLFWwindow* _window = NULL;
+};
+
+#endif
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  if (argc != 2)
+  {
+    std::fprintf(stderr, "usage: gui-batch job.txt\n");
+    return 1;
+  }
+
+  const auto j = read_job(argv[1]);
+  if (!j)
+  {
+    return 1;
+  }
+  if (j->files.empty())
+  {
+    std::fprintf(stderr, "no files in job\n");
+    return 1;
+  }
+
+  init_logging();
+
+  const auto start = std::chrono::steady_clock::now();
+
+  // tasks own copies of their inputs, they may outlive an early return
+  const auto prepare_async = [&j](const std::size_t i)
+  {
+    return default_pool().submit([path = j->files[i], settings = *j]
+                                 { return prepare(path, settings); });
+  };
+
+  // start reading the first file before creating the context
+  auto next = prepare_async(0);
+
+  std::size_t nImages = 0;
+  {
+    const offscreenContext context;
+    if (!context.valid())
+    {
+      std::fprintf(stderr, "Failed to create an OpenGL context\n");
+      return 1;
+    }
+    if (!gladLoadGLLoader(offscreenContext::loader()))
+    {
+      std::fprintf(stderr, "Failed to initialize GLAD\n");
+      return 1;
+    }
+    // opaque background of the viewer, frameBuffer::bind clears with it
+    glClearColor(0.45f, 0.55f, 0.60f, 1.0f);
+
+    const std::filesystem::path file_path{ __FILE__ };
+    shaderRegistry shaders{ file_path.parent_path() / "shaders" };
+    auto& shader = shaders.add("point", "point.vert", "point.frag");
+    auto& colorShader = shaders.add("color", "color.vert", "color.frag");
+
+    uniformBuffer<cameraUniforms> cameraBuffer{ cameraUniforms::binding };
+    shaders.bind_block(cameraUniforms::block_name, cameraUniforms::binding);
+
+    camera cam{ glm::vec3(0, 0, 3),
+                glm::radians(45.0f),
+                float(j->width) / float(j->height),
+                0.1f,
+                100.0f };
+
+    frameBuffer fb{ j->width, j->height };
+    frameCapture capture{};
+    capture.dropWhenBusy = false;
+    data data{};
+
+    std::error_code ec;
+    std::filesystem::create_directories(j->output, ec);
+
+    for (std::size_t i = 0; i < j->files.size(); ++i)
+    {
+      std::optional<preparedFile> current;
+      try
+      {
+        current.emplace(next.get());
+      }
+      catch (const std::exception& e)
+      {
+        log_error("Failed to read {}: {}", j->files[i], e.what());
+      }
+
+      // overlap reading the next file with rendering this one
+      if (i + 1 < j->files.size())
+      {
+        next = prepare_async(i + 1);
+      }
+
+      if (!current)
+      {
+        continue;
+      }
+
+      const auto stem = std::filesystem::path{ j->files[i] }.stem().string();
+      data.load(std::move(current->file));
+
+      for (std::size_t f = 0; f < j->fields.size(); ++f)
+      {
+        triangleBuffer plane{ std::move(current->planes[f].vertices) };
+        const auto fieldName = j->fields[f].empty() ? "zones" : j->fields[f];
+
+        for (const auto& v : j->views)
+        {
+          cam.set_orientation(glm::radians(v.yaw), glm::radians(v.pitch));
+          cam.fit(current->bounds.center(),
+                  glm::length(current->bounds.half_extent()));
+          cam.update(cameraBuffer);
+
+          fb.bind();
+          glEnable(GL_DEPTH_TEST);
+          data.update(shader);
+          data.render(shader);
+          plane.draw(colorShader);
+          glDisable(GL_DEPTH_TEST);
+          fb.unbind();
+
+          capture.capture(fb,
+                          j->output /
+                            (stem + "_" + v.name + "_" + fieldName + ".png"));
+          capture.poll();
+        }
+      }
+    }
+
+    capture.flush();
+    if (capture.dropped() > 0)
+    {
+      log_error("{} images dropped", capture.dropped());
+    }
+    nImages = capture.written();
+  }
+
+  shutdown_logging();
+
+  const auto seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+  std::printf("%zu images in %.2f s, %.1f images per minute\n",
+              nImages,
+              seconds,
+              60.0 * nImages / seconds);
+
+  return 0;
+}
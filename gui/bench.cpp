@@ -0,0 +1,358 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+// Benchmark of the extraction algorithms, runs without a window or OpenGL
+// context.
+//
+// usage: gui-bench [file.cgns]
+//
+// Without a file a synthetic zone with a radial field and a helical vortex
+// as velocity is used.
+
+#include "include/compressedArray.hpp"
+#include "include/cutPlane.hpp"
+#include "include/gridQuality.hpp"
+#include "include/isoSurface.hpp"
+#include "include/memory.hpp"
+#include "include/parallel.hpp"
+#include "include/spatialOrder.hpp"
+#include "include/streamlines.hpp"
+#include "include/structuredZone.hpp"
+#include "include/treeReader.hpp"
+#include "include/volume.hpp"
+#include <algorithm>
+#include <array>
+#include <cgns-tools.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace
+{
+
+using namespace cgns_tools::gui;
+
+/// scheduler counters and memory usage of the whole run
+void
+print_summary()
+{
+  const auto pool = default_pool().statistics();
+  std::printf("scheduler: %zu workers, %zu tasks, %zu steals, %.0f%% idle\n",
+              pool.nWorkers,
+              pool.nTasks,
+              pool.nSteals,
+              1e2 * pool.idle_fraction());
+  memory::print(stdout);
+}
+
+std::vector<structuredZone>
+synthetic_zones(const std::size_t n)
+{
+  structuredZone zone;
+  zone.name = "synthetic";
+  zone.dims = { n, n, n };
+  std::vector<glm::vec3> points(zone.n_points());
+
+  // radius first, it is the iso-surface field
+  constexpr std::array<const char*, 4> names{
+    "radius", "VelocityX", "VelocityY", "VelocityZ"
+  };
+  std::array<std::vector<float>, 4> values;
+  for (auto& v : values)
+  {
+    v.resize(zone.n_points());
+  }
+
+  parallel_for(0,
+               n,
+               1,
+               [&](const std::size_t k)
+               {
+                 for (std::size_t j = 0; j < n; ++j)
+                 {
+                   for (std::size_t i = 0; i < n; ++i)
+                   {
+                     const glm::vec3 p{ float(i) / (n - 1),
+                                        float(j) / (n - 1),
+                                        float(k) / (n - 1) };
+                     const auto index = zone.index(i, j, k);
+                     points[index] = p;
+                     values[0][index] =
+                       glm::length(p - glm::vec3{ 0.5f, 0.5f, 0.5f }) +
+                       0.02f * std::sin(40.0f * p.x);
+                     values[1][index] = 0.5f - p.y;
+                     values[2][index] = p.x - 0.5f;
+                     values[3][index] = 0.2f;
+                   }
+                 }
+               });
+  zone.points = std::move(points);
+
+  for (std::size_t f = 0; f < names.size(); ++f)
+  {
+    auto& field = zone.fields.emplace_back();
+    field.name = names[f];
+    const auto [min, max] =
+      std::minmax_element(values[f].begin(), values[f].end());
+    field.min = *min;
+    field.max = *max;
+    field.values = std::move(values[f]);
+  }
+
+  build_bricks(zone);
+  build_brick_ranges(zone);
+  zone.account_memory();
+
+  std::vector<structuredZone> zones;
+  zones.emplace_back(std::move(zone));
+  return zones;
+}
+
+std::vector<structuredZone>
+file_zones(const std::string& path)
+{
+  auto file = read_file_tree(path);
+  const auto& root = file.tree;
+  if (file.coordinates)
+  {
+    std::printf("coordinates: %.1f MB in %zu chunks, %.2f ms, %.1f MB/s\n",
+                1e-6 * file.coordinates->bytes,
+                file.coordinates->nChunks,
+                1e3 * file.coordinates->seconds,
+                file.coordinates->megabytes_per_second());
+  }
+  std::printf("arrays read: %.1f MB, %.2f ms, %.1f MB/s\n",
+              1e-6 * file.bytes,
+              1e3 * file.seconds,
+              1e-6 * file.bytes / file.seconds);
+
+  std::vector<structuredZone> zones;
+  std::vector<memory::zoneUsage> usage;
+  memory::allocation tree;
+  for (const auto& zone : root.bases[0].zones)
+  {
+    if (const auto* structured =
+          std::get_if<cgns_tools::zoneStructured>(&zone))
+    {
+      std::vector<glm::vec3> points;
+      if (file.coordinates)
+      {
+        points = file.coordinates->take(structured->name);
+      }
+
+      const auto& converted = zones.emplace_back(
+        make_structured_zone(*structured, std::move(points)));
+
+      const auto bytes = tree_bytes(*structured);
+      tree.reset(memory::category::tree, tree.bytes() + bytes);
+      usage.push_back({ converted.name, bytes, converted.size_bytes(), 0 });
+    }
+  }
+  memory::set_zones(std::move(usage));
+  return zones;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const auto zones = argc > 1 ? file_zones(argv[1]) : synthetic_zones(256);
+
+  std::size_t nCells = 0;
+  for (const auto& zone : zones)
+  {
+    nCells += zone.n_cells();
+  }
+  std::printf("zones: %zu, cells: %zu, threads: %zu\n",
+              zones.size(),
+              nCells,
+              default_pool().size() + 1);
+
+  if (zones.empty())
+  {
+    return 1;
+  }
+
+  aabb bounds;
+  for (const auto& zone : zones)
+  {
+    bounds.extend(zone.bounds);
+  }
+
+  // cut planes
+  for (const std::size_t stride : { 1, 4 })
+  {
+    cutPlaneSettings settings;
+    settings.cut.origin = bounds.center();
+    settings.cut.normal = glm::normalize(glm::vec3{ 1.0f, 0.3f, 0.2f });
+    settings.stride = stride;
+
+    const auto result = extract_cut_plane(zones, settings);
+    const auto nTriangles =
+      result.vertices.size() / (3 * triangleBuffer::floats_per_vertex);
+    std::printf("cut plane stride %zu: %zu triangles, %.2f ms\n",
+                stride,
+                nTriangles,
+                1e3 * result.seconds);
+  }
+
+  // grid quality, the metric kernel alone and with histograms and fields
+  {
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t nNegative = 0;
+    for (const auto& zone : zones)
+    {
+      nNegative += compute_zone_quality(zone).nNegative;
+    }
+    const auto seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+        .count();
+    std::printf("quality metrics: %zu negative Jacobians, %.2f ms, "
+                "%.1f Mcells/s\n",
+                nNegative,
+                1e3 * seconds,
+                1e-6 * nCells / seconds);
+
+    const auto result = compute_grid_quality(zones);
+    std::printf("grid quality fields: %.2f ms, %.1f Mcells/s\n",
+                1e3 * result.seconds,
+                1e-6 * result.cells_per_second());
+  }
+
+  // point reordering along the space-filling curve
+  {
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t nPoints = 0;
+    for (const auto& zone : zones)
+    {
+      nPoints += spatial_order(zone).size();
+    }
+    const auto seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+        .count();
+    std::printf("spatial order: %zu points, %.2f ms, %.1f Mpoints/s\n",
+                nPoints,
+                1e3 * seconds,
+                1e-6 * nPoints / seconds);
+  }
+
+  // streamlines from a rake across the vortex
+  if (const auto velocity = guess_velocity(zones.front()))
+  {
+    streamlineSettings settings;
+    settings.velocity = *velocity;
+    settings.start = bounds.min + 0.1f * (bounds.max - bounds.min);
+    settings.end = bounds.max - 0.1f * (bounds.max - bounds.min);
+    settings.nSeeds = 64;
+
+    const auto result = trace_streamlines(zones, settings);
+    std::printf("streamlines: %zu lines, %zu points, %zu steps, %.2f ms, "
+                "%.0f lines/s\n",
+                result.n_lines(),
+                result.nPoints,
+                result.nSteps,
+                1e3 * result.seconds,
+                result.lines_per_second());
+  }
+
+  // volume resampling of the first field
+  if (!zones.front().fields.empty())
+  {
+    volumeSettings settings;
+    settings.field = zones.front().fields.front().name;
+
+    const auto result = resample_volume(zones, settings);
+    std::printf("volume: %zu x %zu x %zu, %zu inside, %.2f ms, "
+                "%.1f Msamples/s\n",
+                result.dims[0],
+                result.dims[1],
+                result.dims[2],
+                result.nInside,
+                1e3 * result.seconds,
+                1e-6 * result.samples_per_second());
+  }
+
+  // field compression, lossless and lossy relative to the value range
+  for (const float tolerance : { 0.0f, 1e-4f })
+  {
+    std::size_t raw = 0;
+    std::size_t compressed = 0;
+    double encodeSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    float maxError = 0.0f;
+    for (const auto& zone : zones)
+    {
+      for (const auto& field : zone.fields)
+      {
+        const auto start = std::chrono::steady_clock::now();
+        const compressedArray array{ field.values,
+                                     tolerance * (field.max - field.min) };
+        const auto encoded = std::chrono::steady_clock::now();
+        const auto values = array.decode();
+        const auto decoded = std::chrono::steady_clock::now();
+
+        encodeSeconds +=
+          std::chrono::duration<double>(encoded - start).count();
+        decodeSeconds +=
+          std::chrono::duration<double>(decoded - encoded).count();
+        raw += array.raw_bytes();
+        compressed += array.compressed_bytes();
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+          maxError = std::max(maxError, std::abs(values[i] - field.values[i]));
+        }
+      }
+    }
+    if (raw > 0)
+    {
+      std::printf("compression tolerance %g: ratio %.2f, encode %.2f GB/s, "
+                  "decode %.2f GB/s, max error %g\n",
+                  tolerance,
+                  double(raw) / double(compressed),
+                  1e-9 * raw / encodeSeconds,
+                  1e-9 * raw / decodeSeconds,
+                  maxError);
+    }
+  }
+
+  // iso-surfaces
+  if (zones.front().fields.empty())
+  {
+    print_summary();
+    return 0;
+  }
+
+  const auto& field = zones.front().fields.front();
+  for (const float t : { 0.25f, 0.5f, 0.75f })
+  {
+    isoSurfaceSettings settings;
+    settings.field = field.name;
+    settings.value = field.min + t * (field.max - field.min);
+
+    const auto result = extract_iso_surface(zones, settings);
+
+    std::vector<float> vertices(result.nVertices *
+                                meshBuffer::floats_per_vertex);
+    std::vector<uint32_t> indices(result.nIndices);
+    write_iso_surface(result, { vertices.data(), indices.data() });
+
+    std::printf("iso-surface %s = %g: %zu triangles, %zu / %zu bricks, "
+                "%.2f ms, %.1f Mcells/s\n",
+                field.name.c_str(),
+                settings.value,
+                result.nIndices / 3,
+                result.nBricksVisited,
+                result.nBricks,
+                1e3 * result.seconds,
+                1e-6 * result.cells_per_second());
+  }
+
+  // peaks include the tree of a file, released after conversion
+  print_summary();
+
+  return 0;
+}
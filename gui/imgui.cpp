@@ -5,7 +5,15 @@
 // + read the top of imgui.cpp. Read online:
 // https://github.com/ocornut/imgui/tree/master/docs
 
+#include "include/camera.hpp"
+#include "include/compressedArray.hpp"
+#include "include/cutPlane.hpp"
 #include "include/data.hpp"
+#include "include/fileWatcher.hpp"
+#include "include/gridQuality.hpp"
+#include "include/isoSurface.hpp"
+#include "include/streamlines.hpp"
+#include "include/volume.hpp"
 #include <glad/glad.h>
 
 #ifdef __APPLE__
@@ -34,17 +42,34 @@
 #pragma comment(lib, "legacy_stdio_definitions")
 #endif
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <filesystem>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <variant>
 
 #include <nfd.hpp>
 
 #include <cgns-tools.hpp>
 
+#include "include/dynamicResolution.hpp"
 #include "include/frameBuffer.hpp"
+#include "include/frameCapture.hpp"
 #include "include/helpers.hpp"
+#include "include/log.hpp"
+#include "include/memory.hpp"
+#include "include/parallel.hpp"
 #include "include/shader.hpp"
+#include "include/shaderRegistry.hpp"
+#include "include/startupProfile.hpp"
+#include "include/trace.hpp"
+#include "include/uniformBuffer.hpp"
 
 // using cgns_tools::gui::opengl_fn;
 
@@ -55,12 +80,64 @@ glfw_error_callback(int error, const char* description)
 }
 
 int
-main(int, char**)
+main(int argc, char** argv)
 {
+  cgns_tools::gui::startupProfile startup{};
+  cgns_tools::gui::init_logging();
+  cgns_tools::gui::trace::set_thread_name("main");
+
+  // usage: gui [--trace] [--watch] [--spatial-order] [--compress] [file.cgns]
+  std::string startupFile;
+  bool watch = false;
+  bool spatialOrder = false;
+  cgns_tools::gui::compressionSettings compression;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg{ argv[i] };
+    if (arg == "--trace")
+    {
+      cgns_tools::gui::trace::start();
+    }
+    else if (arg == "--watch")
+    {
+      watch = true;
+    }
+    else if (arg == "--spatial-order")
+    {
+      spatialOrder = true;
+    }
+    else if (arg == "--compress")
+    {
+      compression.enabled = true;
+    }
+    else
+    {
+      startupFile = arg;
+    }
+  }
+
+  // read and convert a file given on the command line while the window, the
+  // GL context and the fonts are set up
+  const auto read_async =
+    [](std::string path,
+       const bool reorder,
+       const cgns_tools::gui::compressionSettings& compression)
+  {
+    return cgns_tools::gui::default_pool().submit(
+      [path = std::move(path), reorder, compression]
+      { return cgns_tools::gui::read_mesh_file(path, reorder, compression); });
+  };
+  std::future<cgns_tools::gui::meshFile> pendingFile;
+  if (!startupFile.empty())
+  {
+    pendingFile = read_async(startupFile, spatialOrder, compression);
+  }
+
   // Setup window
   glfwSetErrorCallback(glfw_error_callback);
   if (!glfwInit())
     return 1;
+  startup.mark("glfw");
 
     // Decide GL+GLSL versions
 #if defined(IMGUI_IMPL_OPENGL_ES2)
@@ -91,6 +168,7 @@ main(int, char**)
     return 1;
   glfwMakeContextCurrent(window);
   glfwSwapInterval(1); // Enable vsync
+  startup.mark("window");
 
   // Setup Dear ImGui context
   IMGUI_CHECKVERSION();
@@ -154,14 +232,69 @@ main(int, char**)
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
+  startup.mark("imgui and glad");
 
   cgns_tools::gui::data data{};
 
-  cgns_tools::gui::shader shader{};
-  // camera mCamera{ glm::vec3(0, 0, 3), 45.0f, 1.3f, 0.1f, 100.0f };
+  // programs are loaded from the source tree like the font, linked binaries
+  // are cached between runs
+  cgns_tools::gui::shaderRegistry shaders{ source_root_path / "shaders" };
+  auto& shader = shaders.add("point", "point.vert", "point.frag");
+  auto& colorShader = shaders.add("color", "color.vert", "color.frag");
+  auto& wireShader = shaders.add("wire", "wire.vert", "point.frag");
+  auto& volumeShader = shaders.add("volume", "volume.vert", "volume.frag");
+
+  // camera matrices are shared by all programs through one uniform buffer
+  using cgns_tools::gui::cameraUniforms;
+  cgns_tools::gui::uniformBuffer<cameraUniforms> cameraBuffer{
+    cameraUniforms::binding
+  };
+  shaders.bind_block(cameraUniforms::block_name, cameraUniforms::binding);
+
+  cgns_tools::gui::camera mCamera{
+    glm::vec3(0, 0, 3), glm::radians(45.0f), 1.3f, 0.1f, 100.0f
+  };
 
   cgns_tools::gui::frameBuffer frameBuffer{};
 
+  // lower scene resolution while the view changes faster than the target
+  cgns_tools::gui::dynamicResolution resolution{};
+  bool viewInteracting = false;
+
+  // screenshots and image sequences of the viewer
+  cgns_tools::gui::frameCapture capture{};
+  char captureDirectory[256] = "captures";
+  bool captureRequested = false;
+  bool recording = false;
+  std::size_t captureIndex = 0;
+
+  // leading part of spatially ordered points, a uniform subsample
+  float pointFraction = 1.0f;
+
+  // grid lines instead of points, every lineStride-th line on large zones
+  bool wireframe = false;
+  int lineStride = 1;
+  std::size_t nWireframeSkipped = 0;
+
+  cgns_tools::gui::cutPlaneTool cutPlane{};
+  bool cutPlaneDragging = false;
+
+  cgns_tools::gui::isoSurfaceTool isoSurface{};
+
+  cgns_tools::gui::streamlineTool streamlines{};
+
+  cgns_tools::gui::volumeTool volume{};
+
+  cgns_tools::gui::gridQualityTool gridQuality{};
+
+  // watch mode re-reads the file when a solver rewrites it
+  std::optional<cgns_tools::gui::fileWatcher> watcher;
+  bool reloading = false;
+  bool reloadQueued = false;
+  std::optional<std::chrono::system_clock::time_point> reloadWritten;
+  double reloadLatency = 0.0;
+  startup.mark("shaders and buffers");
+
   // Main loop
   while (!glfwWindowShouldClose(window))
   {
@@ -174,7 +307,103 @@ main(int, char**)
     // data to your main application, or clear/overwrite your copy of the
     // keyboard data. Generally you may always pass all inputs to dear imgui,
     // and hide them from your application based on those two flags.
-    glfwPollEvents();
+    const cgns_tools::gui::trace::scope frameScope{ "frame", "frame" };
+    {
+      const cgns_tools::gui::trace::scope traceScope{ "poll events", "frame" };
+      glfwPollEvents();
+    }
+
+    if (pendingFile.valid() &&
+        pendingFile.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready)
+    {
+      try
+      {
+        auto file = pendingFile.get();
+        cgns_tools::gui::log_info(
+          "Read {} in {:.1f} ms", file.path, 1e3 * file.seconds);
+        if (file.readSeconds > 0.0)
+        {
+          cgns_tools::gui::log_info(
+            "Read arrays: {:.1f} MB at {:.1f} MB/s",
+            1e-6 * file.readBytes,
+            1e-6 * file.readBytes / file.readSeconds);
+        }
+        data.load(std::move(file));
+        startup.mark("file");
+
+        if (const auto bounds = data.bounds(); bounds.valid())
+        {
+          mCamera.fit(bounds.center(), glm::length(bounds.half_extent()));
+        }
+      }
+      catch (const std::exception& e)
+      {
+        cgns_tools::gui::log_error("Failed to read file: {}", e.what());
+      }
+    }
+
+    if (watch && data && (!watcher || watcher->path() != data.file()))
+    {
+      watcher.emplace(data.file());
+    }
+    else if (!watch)
+    {
+      watcher.reset();
+    }
+
+    // rewrites during a reload are picked up once it finished
+    reloadQueued |= watcher && watcher->poll();
+    if (reloadQueued && !reloading && !pendingFile.valid())
+    {
+      reloadQueued = false;
+      reloading = true;
+
+      // read on the pool, hand the update to the GL thread for the upload
+      auto& pool = cgns_tools::gui::default_pool();
+      pool.then(
+        pool.run(
+          [path = data.file(), zones = data.zones(), compression]
+          {
+            return cgns_tools::gui::reload_mesh_file(
+              path, *zones, compression);
+          }),
+        [&](std::future<cgns_tools::gui::meshReload> result)
+        {
+          cgns_tools::gui::gl_queue().post(
+            [&, result = std::move(result)]() mutable
+            {
+              reloading = false;
+              try
+              {
+                auto update = result.get();
+                cgns_tools::gui::log_info("Reloaded {} in {:.1f} ms, {} of {} "
+                                          "arrays changed{}",
+                                          update.file.path,
+                                          1e3 * update.file.seconds,
+                                          update.nChanged,
+                                          update.nArrays,
+                                          update.full ? ", full upload" : "");
+                // a file opened meanwhile replaces the watched one
+                if (update.file.path == data.file())
+                {
+                  reloadWritten = update.written;
+                  data.reload(std::move(update));
+                }
+              }
+              catch (const std::exception& e)
+              {
+                cgns_tools::gui::log_error("Failed to reload file: {}",
+                                           e.what());
+              }
+            });
+        });
+    }
+
+    {
+      const cgns_tools::gui::trace::scope traceScope{ "GL queue", "frame" };
+      cgns_tools::gui::gl_queue().drain();
+    }
 
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
@@ -226,6 +455,7 @@ main(int, char**)
       // ImGui::DockBuilderDockWindow("Actions", dock_up_id);
       // ImGui::DockBuilderDockWindow("Hierarchy", dock_right_id);
       ImGui::DockBuilderDockWindow("Properties", dock_left_id);
+      ImGui::DockBuilderDockWindow("Memory", dock_right_id);
       // ImGui::DockBuilderDockWindow("Console", dock_down_id);
       ImGui::DockBuilderDockWindow("Dear ImGui Demo", dock_down_right_id);
       ImGui::DockBuilderDockWindow("Viewer", dock_main_id);
@@ -270,8 +500,11 @@ main(int, char**)
       const auto width = viewportPanelSize.x;
       const auto height = viewportPanelSize.y;
 
-      // mCamera.set_aspect(mSize.x / mSize.y);
-      // mCamera.update(shader);
+      if (width > 0 && height > 0)
+      {
+        mCamera.set_aspect(mSize.x / mSize.y);
+      }
+      mCamera.update(cameraBuffer);
 
       // sometimes at startup a height of zero is encountered
       if (!frameBuffer.fits(width, height) && width > 0 && height > 0)
@@ -279,20 +512,114 @@ main(int, char**)
         frameBuffer.resize(width, height);
       }
 
-      frameBuffer.bind();
+      shaders.poll();
+
+      // interaction of the previous frame, captures are always full size
+      frameBuffer.set_render_scale(
+        resolution.update(viewInteracting || cutPlaneDragging,
+                          captureRequested || recording));
 
-      if (data)
       {
-        data.render(shader);
+        const cgns_tools::gui::trace::scope traceScope{ "scene", "frame" };
+        frameBuffer.bind();
+        resolution.begin();
+        glEnable(GL_DEPTH_TEST);
+
+        if (data && wireframe)
+        {
+          data.update(wireShader);
+          nWireframeSkipped = data.render_grid_lines(wireShader, lineStride);
+        }
+        else if (data)
+        {
+          data.update(shader);
+          data.render(shader, pointFraction);
+        }
+
+        // quality fields replace the zones, before the tools see them
+        if (auto zones = gridQuality.update(data.zones()))
+        {
+          data.set_zones(std::move(zones));
+        }
+
+        cutPlane.update(data.zones(), cutPlaneDragging);
+        cutPlane.render(colorShader);
+
+        isoSurface.update(data.zones());
+        isoSurface.render(colorShader);
+
+        streamlines.update(data.zones());
+        streamlines.render(colorShader);
+
+        // composited over the opaque geometry, rays end at its depth
+        volume.update(data.zones());
+        volume.render(
+          volumeShader,
+          { frameBuffer.get_depth_texture(),
+            glm::inverse(mCamera.get_projection() * mCamera.get_view()),
+            { float(frameBuffer.render_width()),
+              float(frameBuffer.render_height()) } });
+
+        glDisable(GL_DEPTH_TEST);
+        resolution.end();
+        frameBuffer.unbind();
       }
 
-      frameBuffer.unbind();
+      if (captureRequested || recording)
+      {
+        std::error_code ec;
+        std::filesystem::create_directories(captureDirectory, ec);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%06zu.png", captureIndex++);
+        capture.capture(frameBuffer,
+                        std::filesystem::path{ captureDirectory } / name);
+        captureRequested = false;
+      }
+      capture.poll();
 
       // add rendered texture of frame buffer to current imgui window
+      const ImVec2 imagePos = ImGui::GetCursorScreenPos();
+      // a reduced resolution fills the lower left part, stretched to the panel
+      const auto uvMax = frameBuffer.uv_max();
       ImGui::Image(reinterpret_cast<void*>(frameBuffer.get_texture()),
                    ImVec2{ mSize.x, mSize.y },
-                   ImVec2{ 0, 1 },
-                   ImVec2{ 1, 0 });
+                   ImVec2{ 0, uvMax[1] },
+                   ImVec2{ uvMax[0], 0 });
+
+      // camera controls: left drag orbits, right or middle drag pans and the
+      // wheel zooms
+      viewInteracting = false;
+      if (width > 0 && height > 0)
+      {
+        ImGui::SetCursorScreenPos(imagePos);
+        ImGui::InvisibleButton("viewport",
+                               ImVec2{ mSize.x, mSize.y },
+                               ImGuiButtonFlags_MouseButtonLeft |
+                                 ImGuiButtonFlags_MouseButtonRight |
+                                 ImGuiButtonFlags_MouseButtonMiddle);
+
+        if (ImGui::IsItemActive())
+        {
+          const ImVec2 delta = io.MouseDelta;
+          if (ImGui::IsMouseDown(ImGuiMouseButton_Left))
+          {
+            mCamera.orbit(delta.x, delta.y);
+          }
+          else
+          {
+            mCamera.pan(delta.x, delta.y);
+          }
+        }
+
+        if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f)
+        {
+          mCamera.zoom(io.MouseWheel);
+        }
+
+        viewInteracting = ImGui::IsItemActive() ||
+                          (ImGui::IsItemHovered() && io.MouseWheel != 0.0f);
+      }
     }
     ImGui::End();
 
@@ -312,7 +639,8 @@ main(int, char**)
           if (result == NFD_OKAY)
           {
             std::cout << "Success!" << std::endl << outPath.get() << std::endl;
-            data.loadFile(outPath.get());
+            pendingFile =
+              read_async(outPath.get(), spatialOrder, compression);
           }
           else if (result == NFD_CANCEL)
           {
@@ -324,7 +652,545 @@ main(int, char**)
           }
         }
         ImGui::SameLine(0, 5.0f);
-        ImGui::Text("%s", data.file().c_str());
+        ImGui::Text("%s%s",
+                    data.file().c_str(),
+                    pendingFile.valid() ? " (loading)" : "");
+
+        // applies to the next opened file
+        ImGui::Checkbox("Spatial order", &spatialOrder);
+        if (spatialOrder)
+        {
+          ImGui::SameLine(0, 5.0f);
+          ImGui::SliderFloat("Points",
+                             &pointFraction,
+                             0.001f,
+                             1.0f,
+                             "%.3f",
+                             ImGuiSliderFlags_Logarithmic);
+        }
+
+        // applies to the next opened or reloaded file, a tolerance of 0 is
+        // lossless
+        ImGui::Checkbox("Compress fields", &compression.enabled);
+        if (compression.enabled)
+        {
+          ImGui::SameLine(0, 5.0f);
+          ImGui::SliderFloat("Tolerance##compress",
+                             &compression.tolerance,
+                             0.0f,
+                             1e-2f,
+                             "%.1e",
+                             ImGuiSliderFlags_Logarithmic);
+        }
+
+        ImGui::Checkbox("Wireframe", &wireframe);
+        if (wireframe)
+        {
+          ImGui::SameLine(0, 5.0f);
+          ImGui::SliderInt("Line stride", &lineStride, 1, 64);
+          if (nWireframeSkipped > 0)
+          {
+            ImGui::TextColored(ImVec4{ 1.0f, 0.3f, 0.3f, 1.0f },
+                               "%zu zones exceed the buffer texture size",
+                               nWireframeSkipped);
+          }
+        }
+
+        ImGui::Checkbox("Watch", &watch);
+        if (watch && reloadLatency > 0.0)
+        {
+          ImGui::SameLine(0, 5.0f);
+          ImGui::Text("write to image %.1f ms%s",
+                      1e3 * reloadLatency,
+                      reloading ? " (reloading)" : "");
+        }
+      }
+
+      cutPlaneDragging = false;
+      if (data && ImGui::CollapsingHeader("Cut plane"))
+      {
+        auto& settings = cutPlane.settings;
+
+        ImGui::Checkbox("Enabled", &cutPlane.enabled);
+
+        ImGui::DragFloat3("Origin", &settings.cut.origin.x, 0.01f);
+        cutPlaneDragging |= ImGui::IsItemActive();
+
+        if (ImGui::SliderFloat3("Normal", &settings.cut.normal.x, -1.0f, 1.0f))
+        {
+          if (glm::length(settings.cut.normal) < 1e-6f)
+          {
+            settings.cut.normal = { 1.0f, 0.0f, 0.0f };
+          }
+          settings.cut.normal = glm::normalize(settings.cut.normal);
+        }
+        cutPlaneDragging |= ImGui::IsItemActive();
+
+        const auto& zones = *data.zones();
+        const char* preview =
+          settings.field.empty() ? "Zone" : settings.field.c_str();
+        if (ImGui::BeginCombo("Color", preview))
+        {
+          if (ImGui::Selectable("Zone", settings.field.empty()))
+          {
+            settings.field.clear();
+          }
+          if (!zones.empty())
+          {
+            for (const auto& field : zones.front().fields)
+            {
+              if (ImGui::Selectable(field.name.c_str(),
+                                    field.name == settings.field))
+              {
+                settings.field = field.name;
+              }
+            }
+          }
+          ImGui::EndCombo();
+        }
+
+        const auto& stats = cutPlane.last_stats();
+        ImGui::Text("%zu triangles, %zu bricks, %.1f ms%s",
+                    stats.nTriangles,
+                    stats.nBricksVisited,
+                    1e3 * stats.seconds,
+                    cutPlane.busy() ? " (updating)" : "");
+      }
+
+      if (data && ImGui::CollapsingHeader("Iso-surface"))
+      {
+        auto& settings = isoSurface.settings;
+
+        ImGui::Checkbox("Enabled##iso", &isoSurface.enabled);
+
+        const auto& zones = *data.zones();
+        if (ImGui::BeginCombo("Field", settings.field.c_str()))
+        {
+          if (!zones.empty())
+          {
+            for (const auto& field : zones.front().fields)
+            {
+              if (ImGui::Selectable(field.name.c_str(),
+                                    field.name == settings.field))
+              {
+                settings.field = field.name;
+                settings.value = 0.5f * (field.min + field.max);
+              }
+            }
+          }
+          ImGui::EndCombo();
+        }
+
+        float min = std::numeric_limits<float>::max();
+        float max = std::numeric_limits<float>::lowest();
+        for (const auto& zone : zones)
+        {
+          if (const auto* field = zone.field(settings.field))
+          {
+            min = std::min(field->min, min);
+            max = std::max(field->max, max);
+          }
+        }
+        if (min > max)
+        {
+          min = 0.0f;
+          max = 1.0f;
+        }
+        ImGui::SliderFloat("Value", &settings.value, min, max);
+
+        if (const auto stats = isoSurface.last_stats())
+        {
+          ImGui::Text("%zu triangles, %zu / %zu bricks",
+                      stats->nTriangles,
+                      stats->nBricksVisited,
+                      stats->nBricks);
+          ImGui::Text("%.1f ms, %.1f Mcells/s, %zu cached%s",
+                      1e3 * stats->seconds,
+                      1e-6 * stats->cellsPerSecond,
+                      isoSurface.cached(),
+                      isoSurface.busy() ? " (updating)" : "");
+        }
+      }
+
+      if (data && ImGui::CollapsingHeader("Streamlines"))
+      {
+        auto& settings = streamlines.settings;
+
+        ImGui::Checkbox("Enabled##streamlines", &streamlines.enabled);
+
+        const auto& zones = *data.zones();
+        constexpr std::array<const char*, 3> labels{ "Velocity X",
+                                                     "Velocity Y",
+                                                     "Velocity Z" };
+        for (std::size_t d = 0; d < 3; ++d)
+        {
+          if (ImGui::BeginCombo(labels[d], settings.velocity[d].c_str()))
+          {
+            if (!zones.empty())
+            {
+              for (const auto& field : zones.front().fields)
+              {
+                if (ImGui::Selectable(field.name.c_str(),
+                                      field.name == settings.velocity[d]))
+                {
+                  settings.velocity[d] = field.name;
+                }
+              }
+            }
+            ImGui::EndCombo();
+          }
+        }
+
+        int shape = static_cast<int>(settings.shape);
+        ImGui::RadioButton("Rake", &shape, 0);
+        ImGui::SameLine();
+        ImGui::RadioButton("Plane", &shape, 1);
+        settings.shape = static_cast<cgns_tools::gui::seedShape>(shape);
+
+        if (settings.shape == cgns_tools::gui::seedShape::rake)
+        {
+          ImGui::DragFloat3("Start", &settings.start.x, 0.01f);
+          ImGui::DragFloat3("End", &settings.end.x, 0.01f);
+        }
+        else
+        {
+          auto& seedPlane = settings.seedPlane;
+          ImGui::DragFloat3("Origin##seeds", &seedPlane.origin.x, 0.01f);
+          if (ImGui::SliderFloat3(
+                "Normal##seeds", &seedPlane.normal.x, -1.0f, 1.0f))
+          {
+            if (glm::length(seedPlane.normal) < 1e-6f)
+            {
+              seedPlane.normal = { 1.0f, 0.0f, 0.0f };
+            }
+            seedPlane.normal = glm::normalize(seedPlane.normal);
+          }
+          ImGui::DragFloat("Size", &settings.size, 0.01f, 0.0f, 1e6f);
+        }
+
+        int nSeeds = static_cast<int>(settings.nSeeds);
+        if (ImGui::SliderInt("Seeds", &nSeeds, 1, 256))
+        {
+          settings.nSeeds = static_cast<std::size_t>(nSeeds);
+        }
+        int maxSteps = static_cast<int>(settings.maxSteps);
+        if (ImGui::SliderInt("Max steps", &maxSteps, 10, 10000))
+        {
+          settings.maxSteps = static_cast<std::size_t>(maxSteps);
+        }
+        ImGui::SliderFloat("Tolerance",
+                           &settings.tolerance,
+                           1e-5f,
+                           1e-1f,
+                           "%.0e",
+                           ImGuiSliderFlags_Logarithmic);
+        ImGui::Checkbox("Both directions", &settings.bothDirections);
+
+        const auto& stats = streamlines.last_stats();
+        ImGui::Text("%zu / %zu lines, %zu points, %zu steps",
+                    stats.nLines,
+                    stats.nSeeds,
+                    stats.nPoints,
+                    stats.nSteps);
+        ImGui::Text("%.1f ms, %.0f lines/s%s",
+                    1e3 * stats.seconds,
+                    stats.linesPerSecond,
+                    streamlines.busy() ? " (updating)" : "");
+      }
+
+      if (data && ImGui::CollapsingHeader("Volume"))
+      {
+        namespace gui = cgns_tools::gui;
+        auto& settings = volume.settings;
+
+        ImGui::Checkbox("Enabled##volume", &volume.enabled);
+
+        const auto& zones = *data.zones();
+        if (ImGui::BeginCombo("Field##volume", settings.field.c_str()))
+        {
+          if (!zones.empty())
+          {
+            for (const auto& field : zones.front().fields)
+            {
+              if (ImGui::Selectable(field.name.c_str(),
+                                    field.name == settings.field))
+              {
+                settings.field = field.name;
+              }
+            }
+          }
+          ImGui::EndCombo();
+        }
+
+        // texture size of each resolution, to trade quality for memory
+        gui::aabb bounds;
+        for (const auto& zone : zones)
+        {
+          bounds.extend(zone.bounds);
+        }
+        const auto label = [&](const std::size_t resolution)
+        {
+          const auto dims = gui::detail::volume_dims(bounds, resolution);
+          char text[64];
+          std::snprintf(text,
+                        sizeof(text),
+                        "%zu (%.0f MB)",
+                        resolution,
+                        1e-6 * sizeof(float) * dims[0] * dims[1] * dims[2]);
+          return std::string{ text };
+        };
+        if (ImGui::BeginCombo("Resolution",
+                              label(settings.resolution).c_str()))
+        {
+          for (const std::size_t resolution : { 64, 128, 256, 512 })
+          {
+            if (ImGui::Selectable(label(resolution).c_str(),
+                                  resolution == settings.resolution))
+            {
+              settings.resolution = resolution;
+            }
+          }
+          ImGui::EndCombo();
+        }
+
+        ImGui::SliderFloat("Opacity##volume",
+                           &volume.opacity,
+                           0.01f,
+                           10.0f,
+                           "%.2f",
+                           ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Steps per voxel", &volume.quality, 0.25f, 4.0f);
+
+        if (ImGui::TreeNodeEx("Transfer function"))
+        {
+          auto& points = volume.transfer.points;
+          for (std::size_t i = 0; i < points.size(); ++i)
+          {
+            auto& point = points[i];
+            ImGui::PushID(int(i));
+            ImGui::ColorEdit3(
+              "##color", &point.color.x, ImGuiColorEditFlags_NoInputs);
+            ImGui::SameLine(0, 5.0f);
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::SliderFloat("##value", &point.value, 0.0f, 1.0f, "at %.2f");
+            ImGui::SameLine(0, 5.0f);
+            ImGui::SetNextItemWidth(120.0f);
+            ImGui::SliderFloat(
+              "##opacity", &point.opacity, 0.0f, 1.0f, "opacity %.2f");
+            bool removed = false;
+            if (points.size() > 2)
+            {
+              ImGui::SameLine(0, 5.0f);
+              removed = ImGui::Button("x");
+            }
+            ImGui::PopID();
+            if (removed)
+            {
+              points.erase(points.begin() + std::ptrdiff_t(i));
+              break;
+            }
+          }
+
+          if (ImGui::Button("Add point"))
+          {
+            volume.transfer.add_point();
+          }
+          ImGui::SameLine(0, 5.0f);
+          if (ImGui::Button("Reset##transfer"))
+          {
+            volume.transfer = gui::transferFunction::ramp();
+          }
+
+          // opacity over the field range
+          const auto table = volume.transfer.table(64);
+          ImGui::PlotLines("Opacity##transfer",
+                           table.data() + 3,
+                           64,
+                           0,
+                           nullptr,
+                           0.0f,
+                           1.0f,
+                           ImVec2(0, 40.0f),
+                           4 * sizeof(float));
+          ImGui::TreePop();
+        }
+
+        const auto& stats = volume.last_stats();
+        ImGui::Text("%zu x %zu x %zu, %.1f MB, %.0f%% inside",
+                    stats.dims[0],
+                    stats.dims[1],
+                    stats.dims[2],
+                    1e-6 * volume.size_bytes(),
+                    stats.nSamples > 0 ? 1e2 * stats.nInside / stats.nSamples
+                                       : 0.0);
+        ImGui::Text("%.1f ms, %.1f Msamples/s%s",
+                    1e3 * stats.seconds,
+                    1e-6 * stats.samplesPerSecond,
+                    volume.busy() ? " (updating)" : "");
+      }
+
+      if (data && ImGui::CollapsingHeader("Grid quality"))
+      {
+        namespace gui = cgns_tools::gui;
+
+        ImGui::BeginDisabled(gridQuality.busy());
+        if (ImGui::Button("Compute"))
+        {
+          gridQuality.compute();
+        }
+        ImGui::EndDisabled();
+        if (gridQuality.busy())
+        {
+          ImGui::SameLine(0, 5.0f);
+          ImGui::Text("(computing)");
+        }
+
+        if (const auto* result = gridQuality.result())
+        {
+          ImGui::Text("%zu cells, %.1f ms, %.1f Mcells/s",
+                      result->nCells,
+                      1e3 * result->seconds,
+                      1e-6 * result->cells_per_second());
+          if (result->nNegative > 0)
+          {
+            ImGui::TextColored(ImVec4{ 1.0f, 0.3f, 0.3f, 1.0f },
+                               "%zu cells with negative Jacobian",
+                               result->nNegative);
+          }
+          else
+          {
+            ImGui::Text("No negative Jacobians");
+          }
+
+          // metrics are also fields, selectable in the cut plane colors
+          for (std::size_t m = 0; m < gui::n_quality_metrics; ++m)
+          {
+            const auto& histogram = result->histograms[m];
+            std::array<float, gui::qualityHistogram::n_bins> counts;
+            std::copy(histogram.counts.begin(),
+                      histogram.counts.end(),
+                      counts.begin());
+
+            ImGui::PushID(int(m));
+            ImGui::Text("%s: %g to %g, mean %g",
+                        gui::quality_metric_names[m],
+                        histogram.min,
+                        histogram.max,
+                        histogram.mean);
+            ImGui::PlotHistogram("##histogram",
+                                 counts.data(),
+                                 int(counts.size()),
+                                 0,
+                                 nullptr,
+                                 0.0f,
+                                 std::numeric_limits<float>::max(),
+                                 ImVec2{ 0.0f, 60.0f });
+            ImGui::PopID();
+          }
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Capture"))
+      {
+        ImGui::InputText(
+          "Directory", captureDirectory, sizeof(captureDirectory));
+        if (ImGui::Button("Screenshot"))
+        {
+          captureRequested = true;
+        }
+        ImGui::SameLine(0, 5.0f);
+        ImGui::Checkbox("Record", &recording);
+
+        ImGui::Text("%zu written, %zu pending, %zu dropped",
+                    capture.written(),
+                    capture.pending(),
+                    capture.dropped());
+      }
+
+      if (ImGui::CollapsingHeader("Profiler"))
+      {
+        ImGui::Checkbox("Dynamic resolution", &resolution.enabled);
+
+        float targetMs = float(1e3 * resolution.targetSeconds);
+        if (ImGui::SliderFloat("Target (ms)", &targetMs, 4.0f, 100.0f, "%.1f"))
+        {
+          resolution.targetSeconds = 1e-3 * targetMs;
+        }
+        ImGui::SliderFloat("Min scale", &resolution.minScale, 0.1f, 1.0f);
+
+        ImGui::Text("scene %.2f ms (GPU), scale %.2f, %d x %d of %d x %d",
+                    1e3 * resolution.scene_seconds(),
+                    resolution.scale(),
+                    frameBuffer.render_width(),
+                    frameBuffer.render_height(),
+                    frameBuffer.width(),
+                    frameBuffer.height());
+
+        const auto& history = resolution.history();
+        ImGui::PlotLines("Scale",
+                         history.data(),
+                         int(history.size()),
+                         int(resolution.history_offset()),
+                         nullptr,
+                         0.0f,
+                         1.0f,
+                         ImVec2{ 0.0f, 40.0f });
+
+        const auto pool = cgns_tools::gui::default_pool().statistics();
+        ImGui::Text("%zu workers, %zu tasks, %zu steals, %.0f%% idle",
+                    pool.nWorkers,
+                    pool.nTasks,
+                    pool.nSteals,
+                    1e2 * pool.idle_fraction());
+        ImGui::SameLine(0, 5.0f);
+        if (ImGui::Button("Reset##pool"))
+        {
+          cgns_tools::gui::default_pool().reset_stats();
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Tracing"))
+      {
+        namespace trace = cgns_tools::gui::trace;
+
+        bool tracing = trace::enabled();
+        if (ImGui::Checkbox("Record##trace", &tracing))
+        {
+          tracing ? trace::start() : trace::stop();
+        }
+
+        ImGui::SameLine(0, 5.0f);
+        if (ImGui::Button("Save"))
+        {
+          const std::filesystem::path tracePath{ "cgns-tools-gui.trace.json" };
+          if (trace::write_chrome_trace(tracePath))
+          {
+            cgns_tools::gui::log_info("Wrote trace to {}",
+                                      std::filesystem::absolute(tracePath)
+                                        .string());
+          }
+          else
+          {
+            cgns_tools::gui::log_error("Failed to write trace {}",
+                                       tracePath.string());
+          }
+        }
+
+        ImGui::Text("%zu events", trace::n_events());
+      }
+
+      if (ImGui::CollapsingHeader("Shaders"))
+      {
+        ImGui::Checkbox("Hot reload", &shaders.hotReload);
+
+        for (const auto& entry : shaders.entries())
+        {
+          ImGui::Text("%s: %s, %.2f ms%s",
+                      entry.name.c_str(),
+                      entry.cached ? "cached" : "compiled",
+                      1e3 * entry.seconds,
+                      entry.failed ? " (failed)" : "");
+        }
       }
 
       if (data)
@@ -380,9 +1246,76 @@ main(int, char**)
     }
     ImGui::End();
 
+    if (ImGui::Begin("Memory"))
+    {
+      namespace memory = cgns_tools::gui::memory;
+      constexpr double mb = 1.0 / (1024.0 * 1024.0);
+
+      if (ImGui::BeginTable("categories", 3, ImGuiTableFlags_RowBg))
+      {
+        ImGui::TableSetupColumn("Category");
+        ImGui::TableSetupColumn("MB");
+        ImGui::TableSetupColumn("Peak MB");
+        ImGui::TableHeadersRow();
+
+        for (std::size_t c = 0; c < memory::category_names.size(); ++c)
+        {
+          const auto& counter = memory::get(memory::category(c));
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::Text("%s", memory::category_names[c]);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.1f", mb * counter.current.load());
+          ImGui::TableNextColumn();
+          ImGui::Text("%.1f", mb * counter.peak.load());
+        }
+        ImGui::EndTable();
+      }
+
+      if (ImGui::BeginTable("zones", 4, ImGuiTableFlags_RowBg))
+      {
+        ImGui::TableSetupColumn("Zone");
+        ImGui::TableSetupColumn("Tree MB");
+        ImGui::TableSetupColumn("Zone MB");
+        ImGui::TableSetupColumn("GPU MB");
+        ImGui::TableHeadersRow();
+
+        for (const auto& zone : memory::zones())
+        {
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::Text("%s", zone.name.c_str());
+          ImGui::TableNextColumn();
+          ImGui::Text("%.1f", mb * zone.tree);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.1f", mb * zone.zone);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.1f", mb * zone.gpu);
+        }
+        ImGui::EndTable();
+      }
+
+      if (data.zones())
+      {
+        const auto [raw, compressed] =
+          cgns_tools::gui::compressed_bytes(*data.zones());
+        if (compressed > 0)
+        {
+          ImGui::Text("compressed fields %.1f of %.1f MB (%.1fx), decode "
+                      "%.2f GB/s",
+                      mb * compressed,
+                      mb * raw,
+                      double(raw) / double(compressed),
+                      cgns_tools::gui::decode_stats().gb_per_second());
+        }
+      }
+    }
+    ImGui::End();
+
     ImGui::ShowDemoWindow();
 
     // Rendering
+    const cgns_tools::gui::trace::scope renderScope{ "render ui", "frame" };
     ImGui::Render();
     int display_w, display_h;
     glfwGetFramebufferSize(window, &display_w, &display_h);
@@ -394,9 +1327,32 @@ main(int, char**)
     glClear(GL_COLOR_BUFFER_BIT);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
-    glfwSwapBuffers(window);
+    {
+      const cgns_tools::gui::trace::scope traceScope{ "swap", "frame" };
+      glfwSwapBuffers(window);
+    }
+
+    // latency of watch mode from the file write to the first image of it
+    if (reloadWritten)
+    {
+      reloadLatency = std::chrono::duration<double>(
+                        std::chrono::system_clock::now() - *reloadWritten)
+                        .count();
+      reloadWritten.reset();
+      cgns_tools::gui::log_info("Reload latency {:.1f} ms",
+                                1e3 * reloadLatency);
+    }
+
+    // the first image shows the file from the command line, if any
+    if (!pendingFile.valid())
+    {
+      startup.finish("first image");
+    }
   }
 
+  // write outstanding captures while the context is alive
+  capture.flush();
+
   // Cleanup
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
@@ -405,5 +1361,7 @@ main(int, char**)
   glfwDestroyWindow(window);
   glfwTerminate();
 
+  cgns_tools::gui::shutdown_logging();
+
   return 0;
 }
\ No newline at end of file
@@ -3,13 +3,36 @@
 
 #pragma once
 
-#include "shader.hpp"
+#include "uniformBuffer.hpp"
+#include <algorithm>
+#include <cmath>
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/vec2.hpp>
 
 namespace cgns_tools::gui
 {
 
+/// per frame camera state, std140 layout of the Camera uniform block
+struct cameraUniforms
+{
+  /// uniform buffer binding point of the Camera block
+  static constexpr GLuint binding = 0;
+  static constexpr const char* block_name = "Camera";
+
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProjection;
+  glm::vec4 position;
+};
+
+static_assert(sizeof(cameraUniforms) == 3 * 64 + 16,
+              "cameraUniforms must match the std140 layout");
+
+/// orbit camera around a focus point
 struct camera
 {
   camera(const glm::vec3& position,
@@ -28,17 +51,21 @@ struct camera
     update_view_matrix();
   }
 
-  void update(cgns_tools::gui::shader& shader)
+  /// write the camera state into the shared uniform buffer, once per frame
+  void update(uniformBuffer<cameraUniforms>& buffer) const
   {
-    glm::mat4 model{ 1.0f };
-    shader.set_mat4(model, "model");
-    shader.set_mat4(mViewMatrix, "view");
-    shader.set_mat4(get_projection(), "projection");
-    shader.set_vec3(mPosition, "camPos");
+    cameraUniforms uniforms;
+    uniforms.view = mViewMatrix;
+    uniforms.projection = mProjection;
+    uniforms.viewProjection = mProjection * mViewMatrix;
+    uniforms.position = glm::vec4{ mPosition, 1.0f };
+
+    buffer.update(uniforms);
   }
 
   void set_aspect(float aspect)
   {
+    mAspect = aspect;
     mProjection = glm::perspective(mFOV, aspect, mNear, mFar);
   }
 
@@ -52,6 +79,49 @@ struct camera
     mViewMatrix = glm::inverse(mViewMatrix);
   }
 
+  /// rotate around the focus point by a mouse movement in pixels
+  void orbit(const float dx, const float dy)
+  {
+    mYaw += dx * cRotationSpeed;
+    mPitch = std::clamp(mPitch + dy * cRotationSpeed, -cMaxPitch, cMaxPitch);
+    update_view_matrix();
+  }
+
+  /// move the focus point in the view plane by a mouse movement in pixels
+  void pan(const float dx, const float dy)
+  {
+    const float speed = mDistance * cPanSpeed;
+    mFocus += -get_right() * dx * speed + get_up() * dy * speed;
+    update_view_matrix();
+  }
+
+  /// move towards the focus point, one step per mouse wheel notch
+  void zoom(const float steps)
+  {
+    mDistance = std::max(mDistance * std::pow(cZoomFactor, steps), 1e-6f);
+    update_view_matrix();
+  }
+
+  /// set the view direction, yaw around the vertical and pitch in radians
+  void set_orientation(const float yaw, const float pitch)
+  {
+    mYaw = yaw;
+    mPitch = std::clamp(pitch, -cMaxPitch, cMaxPitch);
+    update_view_matrix();
+  }
+
+  /// look at a sphere so that it fills the view
+  void fit(const glm::vec3& center, const float radius)
+  {
+    mFocus = center;
+    mDistance = radius / std::sin(0.5f * mFOV);
+    mNear = std::max(mDistance - 2.0f * radius, 1e-3f * mDistance);
+    mFar = mDistance + 2.0f * radius;
+
+    set_aspect(mAspect);
+    update_view_matrix();
+  }
+
   glm::quat get_direction() const
   {
     return glm::quat(glm::vec3(-mPitch, -mYaw, 0.0f));
@@ -62,8 +132,20 @@ struct camera
     return glm::rotate(get_direction(), cForward);
   }
 
+  glm::vec3 get_right() const
+  {
+    return glm::rotate(get_direction(), glm::vec3{ 1.0f, 0.0f, 0.0f });
+  }
+
+  glm::vec3 get_up() const
+  {
+    return glm::rotate(get_direction(), glm::vec3{ 0.0f, 1.0f, 0.0f });
+  }
+
   const glm::mat4& get_projection() const { return mProjection; }
 
+  const glm::mat4& get_view() const { return mViewMatrix; }
+
 private:
   glm::mat4 mViewMatrix;
   glm::mat4 mProjection = glm::mat4{ 1.0f };
@@ -74,6 +156,7 @@ private:
   float mDistance = 5.0f;
 
   float mFOV;
+  float mAspect;
   float mNear;
   float mFar;
 
@@ -81,6 +164,10 @@ private:
   float mYaw = 0.0f;
 
   const glm::vec3 cForward = { 0.0f, 0.0f, -1.0f };
+  static constexpr float cRotationSpeed = 0.005f;
+  static constexpr float cPanSpeed = 0.0015f;
+  static constexpr float cZoomFactor = 0.9f;
+  static constexpr float cMaxPitch = 1.55f;
 };
 
-} // namespace cgns_tools::gui
\ No newline at end of file
+} // namespace cgns_tools::gui
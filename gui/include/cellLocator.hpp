@@ -0,0 +1,291 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// location of a point in a cell of a structured zone
+struct cellPosition
+{
+  std::size_t zone = 0;
+  std::array<std::size_t, 3> cell{};
+  glm::vec3 local{ 0.5f }; ///< trilinear coordinates in [0, 1]
+};
+
+namespace detail
+{
+
+/// trilinear coordinates of p in a cell by Newton iterations, the result
+/// may lie outside of [0, 1] if p is not in the cell
+inline std::optional<glm::vec3>
+local_coordinates(const structuredZone& zone,
+                  const std::array<std::size_t, 3>& cell,
+                  const glm::vec3& p)
+{
+  std::array<glm::vec3, 8> c;
+  for (std::size_t k = 0; k < 8; ++k)
+  {
+    c[k] = zone.points[zone.index(
+      cell[0] + (k & 1), cell[1] + ((k >> 1) & 1), cell[2] + (k >> 2))];
+  }
+
+  glm::vec3 x{ 0.5f };
+  for (int iteration = 0; iteration < 8; ++iteration)
+  {
+    const glm::vec3 m = 1.0f - x;
+
+    // position and derivatives of the trilinear map at x
+    const glm::vec3 e00 = m.x * c[0] + x.x * c[1];
+    const glm::vec3 e10 = m.x * c[2] + x.x * c[3];
+    const glm::vec3 e01 = m.x * c[4] + x.x * c[5];
+    const glm::vec3 e11 = m.x * c[6] + x.x * c[7];
+    const glm::vec3 f0 = m.y * e00 + x.y * e10;
+    const glm::vec3 f1 = m.y * e01 + x.y * e11;
+    const glm::vec3 position = m.z * f0 + x.z * f1;
+
+    const glm::vec3 di = m.z * (m.y * (c[1] - c[0]) + x.y * (c[3] - c[2])) +
+                         x.z * (m.y * (c[5] - c[4]) + x.y * (c[7] - c[6]));
+    const glm::vec3 dj = m.z * (e10 - e00) + x.z * (e11 - e01);
+    const glm::vec3 dk = f1 - f0;
+
+    const glm::mat3 jacobian{ di, dj, dk };
+    if (std::abs(glm::determinant(jacobian)) <
+        std::numeric_limits<float>::min())
+    {
+      return std::nullopt;
+    }
+
+    const glm::vec3 delta = glm::inverse(jacobian) * (p - position);
+    x += delta;
+    if (glm::dot(delta, delta) < 1e-12f)
+    {
+      break;
+    }
+  }
+  return x;
+}
+
+/// walk from cell towards p through the neighbor cells of the zone
+inline std::optional<cellPosition>
+walk(const std::vector<structuredZone>& zones,
+     const std::size_t iZone,
+     std::array<std::size_t, 3> cell,
+     const glm::vec3& p,
+     const std::size_t maxSteps)
+{
+  constexpr float eps = 1e-4f;
+  const auto& zone = zones[iZone];
+
+  for (std::size_t step = 0; step < maxSteps; ++step)
+  {
+    const auto local = local_coordinates(zone, cell, p);
+    if (!local)
+    {
+      return std::nullopt;
+    }
+
+    bool moved = false;
+    bool inside = true;
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+      if ((*local)[d] < -eps)
+      {
+        inside = false;
+        if (cell[d] > 0)
+        {
+          --cell[d];
+          moved = true;
+        }
+      }
+      else if ((*local)[d] > 1.0f + eps)
+      {
+        inside = false;
+        if (cell[d] + 2 < zone.dims[d])
+        {
+          ++cell[d];
+          moved = true;
+        }
+      }
+    }
+
+    if (inside)
+    {
+      return cellPosition{ iZone, cell, glm::clamp(*local, 0.0f, 1.0f) };
+    }
+    if (!moved)
+    {
+      // p is beyond the boundary of the zone
+      return std::nullopt;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace detail
+
+/// point location in the cells of structured zones
+///
+/// A uniform grid over the domain lists the bricks overlapping each of its
+/// cells. A point is searched by walking from the center of each candidate
+/// brick through the neighbor cells. Subsequent points along a path start
+/// walking from the previous cell and are handed over to the brick grid
+/// when they leave the zone, e.g. into an adjacent block.
+struct cellLocator
+{
+  /// constructor, the zones must outlive the locator
+  explicit cellLocator(const std::vector<structuredZone>& zones)
+    : _zones{ zones }
+    , _bounds{}
+    , _n{ 1, 1, 1 }
+    , _offsets{}
+    , _bricks{}
+  {
+    const trace::scope traceScope{ "build cell locator", "streamlines" };
+
+    std::size_t nBricks = 0;
+    for (const auto& zone : _zones)
+    {
+      _bounds.extend(zone.bounds);
+      nBricks += zone.bricks.size();
+    }
+    if (!_bounds.valid() || nBricks == 0)
+    {
+      _offsets.assign(2, 0);
+      return;
+    }
+
+    // about two grid cells per brick, following the shape of the domain
+    const glm::vec3 extent = glm::max(_bounds.max - _bounds.min, 1e-30f);
+    const float scale =
+      std::cbrt(2.0f * nBricks / (extent.x * extent.y * extent.z));
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+      _n[d] = std::clamp<std::size_t>(
+        std::size_t(std::ceil(extent[d] * scale)), 1, 256);
+    }
+    _scale = glm::vec3{ float(_n[0]), float(_n[1]), float(_n[2]) } / extent;
+
+    // compressed lists of (zone, brick) per grid cell
+    const auto visit = [&](const auto& f)
+    {
+      for (std::size_t z = 0; z < _zones.size(); ++z)
+      {
+        const auto& bricks = _zones[z].bricks;
+        for (std::size_t b = 0; b < bricks.size(); ++b)
+        {
+          const auto lo = grid_cell(bricks[b].bounds.min);
+          const auto hi = grid_cell(bricks[b].bounds.max);
+          for (std::size_t k = lo[2]; k <= hi[2]; ++k)
+          {
+            for (std::size_t j = lo[1]; j <= hi[1]; ++j)
+            {
+              for (std::size_t i = lo[0]; i <= hi[0]; ++i)
+              {
+                f(i + _n[0] * (j + _n[1] * k), z, b);
+              }
+            }
+          }
+        }
+      }
+    };
+
+    _offsets.assign(_n[0] * _n[1] * _n[2] + 1, 0);
+    visit([&](const std::size_t c, std::size_t, std::size_t)
+          { ++_offsets[c + 1]; });
+    for (std::size_t c = 1; c < _offsets.size(); ++c)
+    {
+      _offsets[c] += _offsets[c - 1];
+    }
+
+    _bricks.resize(_offsets.back());
+    auto fill = _offsets;
+    visit([&](const std::size_t c, const std::size_t z, const std::size_t b)
+          { _bricks[fill[c]++] = { uint32_t(z), uint32_t(b) }; });
+  }
+
+  /// cell containing p, if any
+  std::optional<cellPosition> locate(const glm::vec3& p) const
+  {
+    if (!(glm::all(glm::greaterThanEqual(p, _bounds.min)) &&
+          glm::all(glm::lessThanEqual(p, _bounds.max))))
+    {
+      return std::nullopt;
+    }
+
+    const auto g = grid_cell(p);
+    const std::size_t c = g[0] + _n[0] * (g[1] + _n[1] * g[2]);
+    for (std::size_t n = _offsets[c]; n < _offsets[c + 1]; ++n)
+    {
+      const auto [z, b] = _bricks[n];
+      const auto& brick = _zones[z].bricks[b];
+      if (!(glm::all(glm::greaterThanEqual(p, brick.bounds.min)) &&
+            glm::all(glm::lessThanEqual(p, brick.bounds.max))))
+      {
+        continue;
+      }
+
+      std::array<std::size_t, 3> start;
+      for (std::size_t d = 0; d < 3; ++d)
+      {
+        start[d] = (brick.begin[d] + brick.end[d]) / 2;
+      }
+      if (auto position = detail::walk(
+            _zones, z, start, p, 3 * structuredZone::brick_size))
+      {
+        return position;
+      }
+    }
+    return std::nullopt;
+  }
+
+  /// cell containing p, starting the search at a nearby cell
+  std::optional<cellPosition> locate(const glm::vec3& p,
+                                     const cellPosition& hint) const
+  {
+    if (auto position =
+          detail::walk(_zones, hint.zone, hint.cell, p, hand_off_steps))
+    {
+      return position;
+    }
+    return locate(p);
+  }
+
+private:
+  /// steps of a walk before the point is searched in the brick grid
+  static constexpr std::size_t hand_off_steps = 8;
+
+  const std::vector<structuredZone>& _zones;
+  aabb _bounds;
+  std::array<std::size_t, 3> _n;
+  glm::vec3 _scale{ 1.0f };
+  std::vector<uint32_t> _offsets;
+  std::vector<std::pair<uint32_t, uint32_t>> _bricks;
+
+  std::array<std::size_t, 3> grid_cell(const glm::vec3& p) const
+  {
+    const glm::vec3 g = (p - _bounds.min) * _scale;
+    std::array<std::size_t, 3> result;
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+      result[d] = std::min(std::size_t(std::max(g[d], 0.0f)), _n[d] - 1);
+    }
+    return result;
+  }
+};
+
+} // namespace cgns_tools::gui
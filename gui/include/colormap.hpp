@@ -0,0 +1,40 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <glm/glm.hpp>
+
+namespace cgns_tools::gui
+{
+
+/// map t in [0, 1] to a blue - cyan - green - yellow - red color ramp
+inline glm::vec3
+colormap(float t)
+{
+  static constexpr std::array<std::array<float, 3>, 5> ramp{ {
+    { 0.23f, 0.30f, 0.75f },
+    { 0.20f, 0.70f, 0.85f },
+    { 0.35f, 0.80f, 0.35f },
+    { 0.95f, 0.85f, 0.25f },
+    { 0.80f, 0.15f, 0.15f },
+  } };
+
+  t = std::clamp(t, 0.0f, 1.0f) * (ramp.size() - 1);
+  const auto i = std::min(static_cast<std::size_t>(t), ramp.size() - 2);
+  const float w = t - i;
+
+  return glm::vec3{ ramp[i][0], ramp[i][1], ramp[i][2] } * (1.0f - w) +
+         glm::vec3{ ramp[i + 1][0], ramp[i + 1][1], ramp[i + 1][2] } * w;
+}
+
+/// map value in [min, max] to the color ramp
+inline glm::vec3
+colormap(const float value, const float min, const float max)
+{
+  return colormap(max > min ? (value - min) / (max - min) : 0.5f);
+}
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,379 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// compression of the field arrays of converted zones
+struct compressionSettings
+{
+  bool enabled = false;
+  /// largest error relative to the value range of a field, 0 is lossless
+  float tolerance = 0.0f;
+};
+
+/// bytes and time of all decoded blocks, for the decode throughput
+struct decodeStats
+{
+  std::atomic<uint64_t> bytes{ 0 };
+  std::atomic<int64_t> nanoseconds{ 0 };
+
+  double gb_per_second() const noexcept
+  {
+    const auto ns = nanoseconds.load(std::memory_order_relaxed);
+    return ns > 0 ? double(bytes.load(std::memory_order_relaxed)) / double(ns)
+                  : 0.0;
+  }
+};
+
+inline decodeStats&
+decode_stats()
+{
+  static decodeStats stats{};
+  return stats;
+}
+
+namespace detail
+{
+
+/// runs of at least min_run equal bytes are stored as count and byte
+constexpr std::size_t min_run = 3;
+constexpr std::size_t max_run = 127 + min_run;
+constexpr std::size_t max_literal = 128;
+
+/// run length encoding of n bytes: a control byte below 128 is followed by
+/// that many plus one literal bytes, a control byte c from 128 by one byte
+/// repeated c - 128 + min_run times
+inline void
+rle_encode(const uint8_t* in, const std::size_t n, std::vector<uint8_t>& out)
+{
+  const auto flush = [&](std::size_t first, const std::size_t last)
+  {
+    while (first < last)
+    {
+      const std::size_t length = std::min(last - first, max_literal);
+      out.push_back(uint8_t(length - 1));
+      out.insert(out.end(), in + first, in + first + length);
+      first += length;
+    }
+  };
+
+  std::size_t literal = 0;
+  std::size_t i = 0;
+  while (i < n)
+  {
+    std::size_t run = 1;
+    while (i + run < n && run < max_run && in[i + run] == in[i])
+    {
+      ++run;
+    }
+
+    if (run >= min_run)
+    {
+      flush(literal, i);
+      out.push_back(uint8_t(128 + run - min_run));
+      out.push_back(in[i]);
+      literal = i + run;
+    }
+    i += run;
+  }
+  flush(literal, n);
+}
+
+/// decode n bytes, returns the end of the consumed input
+inline const uint8_t*
+rle_decode(const uint8_t* in, uint8_t* out, const std::size_t n)
+{
+  std::size_t o = 0;
+  while (o < n)
+  {
+    const uint8_t c = *in++;
+    if (c < 128)
+    {
+      const std::size_t length = std::size_t(c) + 1;
+      std::memcpy(out + o, in, length);
+      in += length;
+      o += length;
+    }
+    else
+    {
+      const std::size_t length = std::size_t(c) - 128 + min_run;
+      std::memset(out + o, *in++, length);
+      o += length;
+    }
+  }
+  return in;
+}
+
+/// float bits as unsigned integers in the order of the floats
+inline uint32_t
+ordered_bits(const float v)
+{
+  uint32_t u;
+  std::memcpy(&u, &v, sizeof(u));
+  return u & 0x80000000u ? ~u : u | 0x80000000u;
+}
+
+inline float
+from_ordered_bits(const uint32_t o)
+{
+  const uint32_t u = o & 0x80000000u ? o & 0x7fffffffu : ~o;
+  float v;
+  std::memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+inline uint32_t
+zigzag(const uint32_t delta)
+{
+  const auto s = int32_t(delta);
+  return uint32_t(s) << 1 ^ uint32_t(s >> 31);
+}
+
+inline uint32_t
+unzigzag(const uint32_t z)
+{
+  return z >> 1 ^ (0u - (z & 1u));
+}
+
+} // namespace detail
+
+/// float array held in independently compressed blocks
+///
+/// The values of a block are mapped to integers, either their bits or, with
+/// an error bound, their index on a grid of twice that spacing. Differences
+/// of neighbors are split into byte planes (byte shuffle) and each plane is
+/// run length encoded, so the mostly zero high bytes of smooth fields shrink
+/// to a few control bytes. Blocks are encoded and decoded in parallel.
+struct compressedArray
+{
+  /// values per block
+  static constexpr std::size_t block_size = std::size_t(1) << 14;
+
+  compressedArray() = default;
+
+  /// compress values, with a positive maxError lossy with an absolute error
+  /// of at most maxError up to float rounding, lossless if the values or
+  /// their range do not allow for it
+  compressedArray(const std::vector<float>& values, const float maxError)
+    : _size{ values.size() }
+  {
+    const trace::scope traceScope{ "compress array", "convert" };
+
+    const std::size_t nBlocks = (_size + block_size - 1) / block_size;
+
+    if (maxError > 0.0f)
+    {
+      std::vector<float> blockMin(nBlocks, std::numeric_limits<float>::max());
+      std::vector<float> blockMax(nBlocks,
+                                  std::numeric_limits<float>::lowest());
+      std::vector<uint8_t> finite(nBlocks, 1);
+      parallel_for(0,
+                   nBlocks,
+                   1,
+                   [&](const std::size_t b)
+                   {
+                     const std::size_t end =
+                       std::min(_size, (b + 1) * block_size);
+                     for (std::size_t i = b * block_size; i < end; ++i)
+                     {
+                       finite[b] &= std::isfinite(values[i]);
+                       blockMin[b] = std::min(blockMin[b], values[i]);
+                       blockMax[b] = std::max(blockMax[b], values[i]);
+                     }
+                   });
+
+      const bool allFinite = std::all_of(
+        finite.begin(), finite.end(), [](const uint8_t f) { return f != 0; });
+      const double step = 2.0 * double(maxError);
+      const double min =
+        nBlocks > 0 ? *std::min_element(blockMin.begin(), blockMin.end()) : 0.0;
+      const double max =
+        nBlocks > 0 ? *std::max_element(blockMax.begin(), blockMax.end()) : 0.0;
+      if (allFinite &&
+          (max - min) / step < double(std::numeric_limits<int32_t>::max()))
+      {
+        _step = step;
+        _offset = min;
+      }
+    }
+
+    std::vector<std::vector<uint8_t>> blocks(nBlocks);
+    parallel_for(0,
+                 nBlocks,
+                 1,
+                 [&](const std::size_t b)
+                 {
+                   const std::size_t first = b * block_size;
+                   const std::size_t n = std::min(_size - first, block_size);
+                   blocks[b] = encode_block(values.data() + first, n);
+                 });
+
+    _offsets.resize(nBlocks + 1, 0);
+    for (std::size_t b = 0; b < nBlocks; ++b)
+    {
+      _offsets[b + 1] = _offsets[b] + blocks[b].size();
+    }
+    _bytes.resize(_offsets.back());
+    parallel_for(0,
+                 nBlocks,
+                 1,
+                 [&](const std::size_t b)
+                 {
+                   std::copy(blocks[b].begin(),
+                             blocks[b].end(),
+                             _bytes.begin() + std::ptrdiff_t(_offsets[b]));
+                 });
+    _usage.reset(memory::category::zones, compressed_bytes());
+  }
+
+  std::size_t size() const noexcept { return _size; }
+
+  bool lossy() const noexcept { return _step > 0.0; }
+
+  /// largest absolute error of the decoded values
+  float max_error() const noexcept { return float(0.5 * _step); }
+
+  std::size_t raw_bytes() const noexcept { return _size * sizeof(float); }
+
+  std::size_t compressed_bytes() const noexcept
+  {
+    return _bytes.capacity() + _offsets.capacity() * sizeof(std::size_t);
+  }
+
+  double ratio() const noexcept
+  {
+    const std::size_t n = compressed_bytes();
+    return n > 0 ? double(raw_bytes()) / double(n) : 1.0;
+  }
+
+  /// decode all blocks in parallel into out, which holds size() values
+  void decode(float* out) const
+  {
+    const trace::scope traceScope{ "decode array", "convert" };
+    const auto start = std::chrono::steady_clock::now();
+
+    parallel_for(0,
+                 _offsets.size() - 1,
+                 1,
+                 [&](const std::size_t b)
+                 {
+                   const std::size_t first = b * block_size;
+                   decode_block(
+                     b, out + first, std::min(_size - first, block_size));
+                 });
+
+    auto& stats = decode_stats();
+    stats.bytes.fetch_add(raw_bytes(), std::memory_order_relaxed);
+    stats.nanoseconds.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start)
+        .count(),
+      std::memory_order_relaxed);
+  }
+
+  std::vector<float> decode() const
+  {
+    std::vector<float> values(_size);
+    decode(values.data());
+    return values;
+  }
+
+private:
+  std::size_t _size = 0;
+  /// grid spacing and origin of lossy values, a zero step is lossless
+  double _step = 0.0;
+  double _offset = 0.0;
+  std::vector<uint8_t> _bytes;
+  /// first byte of each block and the end of the last
+  std::vector<std::size_t> _offsets{ 0 };
+  /// accounted once for all zones sharing the array
+  memory::allocation _usage;
+
+  std::vector<uint8_t> encode_block(const float* values,
+                                    const std::size_t n) const
+  {
+    std::vector<uint32_t> words(n);
+    uint32_t previous = 0;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      const uint32_t w =
+        lossy() ? uint32_t(std::llround((double(values[i]) - _offset) / _step))
+                : detail::ordered_bits(values[i]);
+      words[i] = detail::zigzag(w - previous);
+      previous = w;
+    }
+
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> plane(n);
+    for (unsigned shift = 0; shift < 32; shift += 8)
+    {
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        plane[i] = uint8_t(words[i] >> shift);
+      }
+      detail::rle_encode(plane.data(), n, out);
+    }
+    return out;
+  }
+
+  void decode_block(const std::size_t b, float* out, const std::size_t n) const
+  {
+    thread_local std::vector<uint8_t> planes;
+    thread_local std::vector<uint32_t> words;
+    planes.resize(4 * n);
+    words.resize(n);
+
+    const uint8_t* in = _bytes.data() + _offsets[b];
+    for (std::size_t p = 0; p < 4; ++p)
+    {
+      in = detail::rle_decode(in, planes.data() + p * n, n);
+    }
+
+    const uint8_t* p0 = planes.data();
+    const uint8_t* p1 = p0 + n;
+    const uint8_t* p2 = p1 + n;
+    const uint8_t* p3 = p2 + n;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      words[i] = detail::unzigzag(uint32_t(p0[i]) | uint32_t(p1[i]) << 8 |
+                                  uint32_t(p2[i]) << 16 |
+                                  uint32_t(p3[i]) << 24);
+    }
+
+    uint32_t w = 0;
+    if (lossy())
+    {
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        w += words[i];
+        out[i] = float(_offset + _step * double(w));
+      }
+    }
+    else
+    {
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        w += words[i];
+        out[i] = detail::from_ordered_bits(w);
+      }
+    }
+  }
+};
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,487 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <hdf5.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace cgns_tools::gui
+{
+
+/// location of a coordinate array stored contiguously in the file
+struct coordinateArray
+{
+  uint64_t offset = 0;  ///< byte offset of the first value
+  bool isDouble = true; ///< 8 or 4 byte little endian floating point
+};
+
+/// coordinates of one structured zone
+struct coordinatePlan
+{
+  std::string name;
+  std::array<std::size_t, 3> dims; ///< vertices per direction
+  std::array<coordinateArray, 3> arrays;
+};
+
+/// points of the structured zones by name, with the achieved throughput
+struct coordinateReadResult
+{
+  std::unordered_map<std::string, std::vector<glm::vec3>> points;
+  std::size_t bytes = 0;
+  std::size_t nChunks = 0;
+  double seconds = 0.0;
+
+  double megabytes_per_second() const
+  {
+    return seconds > 0.0 ? 1e-6 * bytes / seconds : 0.0;
+  }
+
+  /// move the points of a zone out, empty if they were not read
+  std::vector<glm::vec3> take(const std::string& name)
+  {
+    const auto it = points.find(name);
+    return it != points.end() ? std::move(it->second)
+                              : std::vector<glm::vec3>{};
+  }
+};
+
+namespace detail
+{
+
+/// owning HDF5 identifier
+struct h5id
+{
+  hid_t id;
+  herr_t (*close)(hid_t);
+
+  ~h5id()
+  {
+    if (id >= 0)
+    {
+      close(id);
+    }
+  }
+
+  operator hid_t() const { return id; }
+  bool valid() const { return id >= 0; }
+};
+
+/// string attribute of a CGNS/HDF5 node, e.g. its label
+inline std::string
+node_attribute(const hid_t node, const char* name)
+{
+  if (H5Aexists(node, name) <= 0)
+  {
+    return {};
+  }
+  const h5id attr{ H5Aopen(node, name, H5P_DEFAULT), &H5Aclose };
+  const h5id type{ H5Aget_type(attr), &H5Tclose };
+  if (!attr.valid() || !type.valid() || H5Tget_class(type) != H5T_STRING)
+  {
+    return {};
+  }
+
+  std::string value(H5Tget_size(type), '\0');
+  if (H5Aread(attr, type, value.data()) < 0)
+  {
+    return {};
+  }
+  value.resize(std::strlen(value.c_str()));
+  return value;
+}
+
+/// child groups of a CGNS/HDF5 node with the given label
+inline std::vector<std::string>
+children(const hid_t node, const std::string& label)
+{
+  std::vector<std::string> result;
+
+  H5G_info_t info;
+  if (H5Gget_info(node, &info) < 0)
+  {
+    return result;
+  }
+
+  for (hsize_t i = 0; i < info.nlinks; ++i)
+  {
+    char name[64];
+    if (H5Lget_name_by_idx(node,
+                           ".",
+                           H5_INDEX_NAME,
+                           H5_ITER_INC,
+                           i,
+                           name,
+                           sizeof(name),
+                           H5P_DEFAULT) <= 0 ||
+        name[0] == ' ')
+    {
+      // names starting with a blank hold node data, not children
+      continue;
+    }
+
+    H5L_info_t link;
+    if (H5Lget_info(node, name, &link, H5P_DEFAULT) < 0 ||
+        link.type != H5L_TYPE_HARD)
+    {
+      continue;
+    }
+
+    const h5id child{ H5Oopen(node, name, H5P_DEFAULT), &H5Oclose };
+    if (child.valid() && H5Iget_type(child) == H5I_GROUP &&
+        node_attribute(child, "label") == label)
+    {
+      result.emplace_back(name);
+    }
+  }
+
+  return result;
+}
+
+/// the " data" dataset of a node, read as 64 bit integers
+inline std::vector<int64_t>
+node_integers(const hid_t node)
+{
+  const h5id data{ H5Dopen2(node, " data", H5P_DEFAULT), &H5Dclose };
+  if (!data.valid())
+  {
+    return {};
+  }
+  const h5id space{ H5Dget_space(data), &H5Sclose };
+  const auto n = H5Sget_simple_extent_npoints(space);
+  std::vector<int64_t> values(std::max<hssize_t>(n, 0));
+  if (H5Dread(data,
+              H5T_NATIVE_INT64,
+              H5S_ALL,
+              H5S_ALL,
+              H5P_DEFAULT,
+              values.data()) < 0)
+  {
+    return {};
+  }
+  return values;
+}
+
+/// the " data" dataset of a node, read as characters
+inline std::string
+node_string(const hid_t node)
+{
+  const h5id data{ H5Dopen2(node, " data", H5P_DEFAULT), &H5Dclose };
+  if (!data.valid())
+  {
+    return {};
+  }
+  const h5id space{ H5Dget_space(data), &H5Sclose };
+  const auto n = H5Sget_simple_extent_npoints(space);
+  std::string value(std::max<hssize_t>(n, 0), '\0');
+  if (H5Dread(data,
+              H5T_NATIVE_CHAR,
+              H5S_ALL,
+              H5S_ALL,
+              H5P_DEFAULT,
+              value.data()) < 0)
+  {
+    return {};
+  }
+  return value;
+}
+
+/// file location of a coordinate array, nullopt if it is chunked,
+/// compressed or not stored as little endian float or double
+inline std::optional<coordinateArray>
+contiguous_array(const hid_t node, const std::size_t nPoints)
+{
+  const h5id data{ H5Dopen2(node, " data", H5P_DEFAULT), &H5Dclose };
+  if (!data.valid())
+  {
+    return std::nullopt;
+  }
+
+  const h5id space{ H5Dget_space(data), &H5Sclose };
+  const h5id type{ H5Dget_type(data), &H5Tclose };
+  if (H5Sget_simple_extent_npoints(space) != hssize_t(nPoints) ||
+      H5Tget_class(type) != H5T_FLOAT || H5Tget_order(type) != H5T_ORDER_LE)
+  {
+    return std::nullopt;
+  }
+
+  const auto size = H5Tget_size(type);
+  const auto offset = H5Dget_offset(data);
+  if ((size != 4 && size != 8) || offset == HADDR_UNDEF ||
+      H5Dget_storage_size(data) != nPoints * size)
+  {
+    return std::nullopt;
+  }
+
+  return coordinateArray{ offset, size == 8 };
+}
+
+} // namespace detail
+
+/// HDF5 is built without thread safety, every call into it, including those
+/// made by cgns-tools, holds this mutex
+inline std::mutex&
+hdf5_mutex()
+{
+  static std::mutex instance;
+  return instance;
+}
+
+/// locate the coordinates of the structured zones of the first base
+///
+/// Only HDF5 metadata is read. Returns nullopt if the file is not CGNS/HDF5
+/// or any coordinate array cannot be read directly, the caller then falls
+/// back to the arrays read by cgns-tools, see read_file_tree.
+inline std::optional<std::vector<coordinatePlan>>
+plan_coordinate_reads(const std::string& path)
+{
+#ifdef _WIN32
+  return std::nullopt;
+#else
+  using detail::h5id;
+  const trace::scope traceScope{ "plan coordinate reads", "io" };
+  const std::lock_guard lock{ hdf5_mutex() };
+
+  // the CGNS/HDF5 signature check keeps HDF5 from printing errors for
+  // other formats
+  if (H5Fis_hdf5(path.c_str()) <= 0)
+  {
+    return std::nullopt;
+  }
+
+  const h5id file{ H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT),
+                   &H5Fclose };
+  if (!file.valid())
+  {
+    return std::nullopt;
+  }
+
+  const h5id rootGroup{ H5Gopen2(file, "/", H5P_DEFAULT), &H5Gclose };
+  const auto bases = detail::children(rootGroup, "CGNSBase_t");
+  if (bases.empty())
+  {
+    return std::nullopt;
+  }
+
+  const h5id base{ H5Gopen2(rootGroup, bases.front().c_str(), H5P_DEFAULT),
+                   &H5Gclose };
+
+  std::vector<coordinatePlan> plans;
+  for (const auto& zoneName : detail::children(base, "Zone_t"))
+  {
+    const h5id zone{ H5Gopen2(base, zoneName.c_str(), H5P_DEFAULT),
+                     &H5Gclose };
+
+    const auto zoneTypes = detail::children(zone, "ZoneType_t");
+    if (zoneTypes.size() != 1)
+    {
+      return std::nullopt;
+    }
+    {
+      const h5id zoneType{
+        H5Gopen2(zone, zoneTypes[0].c_str(), H5P_DEFAULT), &H5Gclose
+      };
+      if (detail::node_string(zoneType).rfind("Structured", 0) != 0)
+      {
+        continue;
+      }
+    }
+
+    // cgns zone size layout: vertex sizes first, followed by cell sizes
+    const auto size = detail::node_integers(zone);
+    if (size.size() != 9)
+    {
+      return std::nullopt;
+    }
+
+    coordinatePlan plan;
+    plan.name = zoneName;
+    plan.dims = { std::size_t(size[0]),
+                  std::size_t(size[1]),
+                  std::size_t(size[2]) };
+    const auto nPoints = plan.dims[0] * plan.dims[1] * plan.dims[2];
+
+    const auto grids = detail::children(zone, "GridCoordinates_t");
+    if (grids.empty())
+    {
+      return std::nullopt;
+    }
+    const h5id grid{ H5Gopen2(zone, grids.front().c_str(), H5P_DEFAULT),
+                     &H5Gclose };
+
+    constexpr std::array<const char*, 3> names{ "CoordinateX",
+                                                "CoordinateY",
+                                                "CoordinateZ" };
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+      if (H5Lexists(grid, names[d], H5P_DEFAULT) <= 0)
+      {
+        return std::nullopt;
+      }
+      const h5id array{ H5Gopen2(grid, names[d], H5P_DEFAULT), &H5Gclose };
+      const auto location = detail::contiguous_array(array, nPoints);
+      if (!location)
+      {
+        return std::nullopt;
+      }
+      plan.arrays[d] = *location;
+    }
+
+    plans.emplace_back(std::move(plan));
+  }
+
+  return plans;
+#endif
+}
+
+/// read the coordinates of all planned zones concurrently
+///
+/// Each array is split into slabs of whole k planes, the slabs of all zones
+/// and directions are read with positional reads in parallel and converted
+/// to float by the reading thread as soon as they arrive. No HDF5 calls are
+/// made, so reading may overlap with reading the tree of the same file.
+inline std::optional<coordinateReadResult>
+read_coordinates(const std::string& path,
+                 const std::vector<coordinatePlan>& plans,
+                 const std::size_t slabBytes = std::size_t(8) << 20)
+{
+#ifdef _WIN32
+  return std::nullopt;
+#else
+  const trace::scope traceScope{ "read coordinates", "io" };
+  const auto start = std::chrono::steady_clock::now();
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return std::nullopt;
+  }
+
+  struct slab
+  {
+    std::vector<glm::vec3>* points;
+    const coordinateArray* array;
+    std::size_t direction;
+    std::size_t begin; ///< first point
+    std::size_t end;   ///< one past the last point
+  };
+
+  coordinateReadResult result;
+  std::vector<slab> slabs;
+  for (const auto& plan : plans)
+  {
+    auto& points = result.points[plan.name];
+    points.resize(plan.dims[0] * plan.dims[1] * plan.dims[2]);
+
+    const std::size_t plane = plan.dims[0] * plan.dims[1];
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+      const auto& array = plan.arrays[d];
+      const std::size_t valueSize = array.isDouble ? 8 : 4;
+      const std::size_t planes =
+        std::max<std::size_t>(1, slabBytes / std::max<std::size_t>(
+                                               plane * valueSize, 1));
+
+      for (std::size_t k = 0; k < plan.dims[2]; k += planes)
+      {
+        slabs.push_back({ &points,
+                          &array,
+                          d,
+                          k * plane,
+                          std::min(k + planes, plan.dims[2]) * plane });
+      }
+      result.bytes += points.size() * valueSize;
+    }
+  }
+
+  std::atomic<bool> failed{ false };
+  parallel_for(
+    0,
+    slabs.size(),
+    1,
+    [&](const std::size_t iSlab)
+    {
+      const auto& s = slabs[iSlab];
+      const std::size_t valueSize = s.array->isDouble ? 8 : 4;
+      const std::size_t n = s.end - s.begin;
+
+      // released with the slab, at most slabBytes per reading thread
+      const std::size_t size = n * valueSize;
+      const auto buffer = std::make_unique_for_overwrite<char[]>(size);
+      const memory::allocation bufferMemory{ memory::category::staging, size };
+
+      {
+        const trace::scope readScope{ "read slab", "io" };
+        std::size_t done = 0;
+        while (done < size)
+        {
+          const auto count =
+            ::pread(fd,
+                    buffer.get() + done,
+                    size - done,
+                    off_t(s.array->offset + s.begin * valueSize + done));
+          if (count <= 0)
+          {
+            failed = true;
+            return;
+          }
+          done += std::size_t(count);
+        }
+      }
+
+      const trace::scope convertScope{ "convert slab", "convert" };
+      auto* points = s.points->data() + s.begin;
+      if (s.array->isDouble)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          double v;
+          std::memcpy(&v, buffer.get() + 8 * i, 8);
+          points[i][s.direction] = static_cast<float>(v);
+        }
+      }
+      else
+      {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          std::memcpy(&points[i][s.direction], buffer.get() + 4 * i, 4);
+        }
+      }
+    });
+
+  ::close(fd);
+  if (failed)
+  {
+    return std::nullopt;
+  }
+
+  result.nChunks = slabs.size();
+  result.seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+  return result;
+#endif
+}
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,377 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "colormap.hpp"
+#include "marchingTetrahedra.hpp"
+#include "parallel.hpp"
+#include "shader.hpp"
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include "triangleBuffer.hpp"
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <future>
+#include <glm/glm.hpp>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// plane through origin with normal
+struct plane
+{
+  glm::vec3 origin{ 0.0f, 0.0f, 0.0f };
+  glm::vec3 normal{ 1.0f, 0.0f, 0.0f };
+
+  float distance(const glm::vec3& p) const
+  {
+    return glm::dot(normal, p - origin);
+  }
+
+  /// true if the plane passes through the box
+  bool intersects(const aabb& box) const
+  {
+    const float r = glm::dot(box.half_extent(), glm::abs(normal));
+    return std::abs(distance(box.center())) <= r;
+  }
+
+  bool operator==(const plane& other) const
+  {
+    return origin == other.origin && normal == other.normal;
+  }
+};
+
+namespace detail
+{
+
+struct cutVertex
+{
+  glm::vec3 position;
+  float value;
+};
+
+} // namespace detail
+
+/// parameters of a cut plane extraction
+struct cutPlaneSettings
+{
+  plane cut;
+  std::string field; ///< color field, empty for coloring by zone
+  std::size_t stride = 1; ///< cells per extraction cell and direction
+};
+
+/// triangles of a cut plane, interleaved as in triangleBuffer
+struct cutPlaneResult
+{
+  cutPlaneSettings settings;
+  std::vector<float> vertices;
+  std::size_t nBricksVisited = 0;
+  double seconds = 0.0;
+};
+
+/// extract the cut plane through all zones
+///
+/// Bricks not touched by the plane are skipped, the remaining bricks are
+/// triangulated in parallel via marching tetrahedra. With a stride > 1 every
+/// stride-th point is used, giving a coarse preview for interaction.
+inline cutPlaneResult
+extract_cut_plane(const std::vector<structuredZone>& zones,
+                  const cutPlaneSettings& settings)
+{
+  const trace::scope traceScope{ "extract cut plane", "extract" };
+  const auto start = std::chrono::steady_clock::now();
+
+  cutPlaneResult result;
+  result.settings = settings;
+
+  struct brickRef
+  {
+    std::size_t zone;
+    std::size_t brick;
+  };
+
+  std::vector<brickRef> touched;
+  for (std::size_t z = 0; z < zones.size(); ++z)
+  {
+    for (std::size_t b = 0; b < zones[z].bricks.size(); ++b)
+    {
+      if (settings.cut.intersects(zones[z].bricks[b].bounds))
+      {
+        touched.push_back({ z, b });
+      }
+    }
+  }
+  result.nBricksVisited = touched.size();
+
+  // color range over all zones
+  float min = 0.0f;
+  float max = static_cast<float>(std::max<std::size_t>(zones.size(), 2) - 1);
+  if (!settings.field.empty())
+  {
+    min = std::numeric_limits<float>::max();
+    max = std::numeric_limits<float>::lowest();
+    for (const auto& zone : zones)
+    {
+      if (const auto* f = zone.field(settings.field))
+      {
+        min = std::min(min, f->min);
+        max = std::max(max, f->max);
+      }
+    }
+  }
+
+  const std::size_t stride = std::max<std::size_t>(settings.stride, 1);
+
+  // field values of the touched zones, compressed fields are decoded here
+  std::vector<std::optional<fieldValues>> zoneValues(zones.size());
+  if (!settings.field.empty())
+  {
+    for (const auto& t : touched)
+    {
+      const auto* f = zones[t.zone].field(settings.field);
+      if (f && !zoneValues[t.zone])
+      {
+        zoneValues[t.zone].emplace(*f);
+      }
+    }
+  }
+
+  std::vector<std::vector<float>> perBrick(touched.size());
+
+  parallel_for(
+    0,
+    touched.size(),
+    1,
+    [&](const std::size_t iTouched)
+    {
+      const auto& zone = zones[touched[iTouched].zone];
+      const auto& brick = zone.bricks[touched[iTouched].brick];
+      const auto& values = zoneValues[touched[iTouched].zone];
+      const float zoneValue = static_cast<float>(touched[iTouched].zone);
+
+      auto& out = perBrick[iTouched];
+
+      const auto emitVertex = [&](const detail::cutVertex& v)
+      {
+        const glm::vec3 color = colormap(v.value, min, max);
+        out.insert(out.end(),
+                   { v.position.x,
+                     v.position.y,
+                     v.position.z,
+                     color.x,
+                     color.y,
+                     color.z });
+      };
+
+      std::array<detail::cutVertex, 4> tetVertices;
+      std::array<float, 4> tetDist;
+
+      const auto emitEdgeVertex = [&](const tetEdge& e)
+      {
+        const auto& a = tetVertices[e[0]];
+        const auto& b = tetVertices[e[1]];
+        const float t = edge_weight(tetDist[e[0]], tetDist[e[1]]);
+        emitVertex({ a.position + t * (b.position - a.position),
+                     a.value + t * (b.value - a.value) });
+      };
+
+      const auto emit =
+        [&](const tetEdge& a, const tetEdge& b, const tetEdge& c)
+      {
+        emitEdgeVertex(a);
+        emitEdgeVertex(b);
+        emitEdgeVertex(c);
+      };
+
+      // bricks are aligned to the stride, so coarse cells never straddle
+      // brick boundaries
+      for (std::size_t k = brick.begin[2]; k < brick.end[2]; k += stride)
+      {
+        for (std::size_t j = brick.begin[1]; j < brick.end[1]; j += stride)
+        {
+          for (std::size_t i = brick.begin[0]; i < brick.end[0]; i += stride)
+          {
+            const std::array<std::size_t, 3> lo{ i, j, k };
+            const std::array<std::size_t, 3> hi{
+              std::min(i + stride, brick.end[0]),
+              std::min(j + stride, brick.end[1]),
+              std::min(k + stride, brick.end[2])
+            };
+
+            std::array<detail::cutVertex, 8> corners;
+            std::array<float, 8> d;
+            bool hasInside = false;
+            bool hasOutside = false;
+            for (std::size_t c = 0; c < 8; ++c)
+            {
+              const auto& o = hex_corners[c];
+              const auto p = zone.index(o[0] ? hi[0] : lo[0],
+                                        o[1] ? hi[1] : lo[1],
+                                        o[2] ? hi[2] : lo[2]);
+              corners[c] = { zone.points[p],
+                             values ? (*values)[p] : zoneValue };
+              d[c] = settings.cut.distance(corners[c].position);
+              (d[c] >= 0.0f ? hasInside : hasOutside) = true;
+            }
+
+            if (!hasInside || !hasOutside)
+            {
+              continue;
+            }
+
+            for (const auto& tet : hex_tets)
+            {
+              for (std::size_t q = 0; q < 4; ++q)
+              {
+                tetVertices[q] = corners[tet[q]];
+                tetDist[q] = d[tet[q]];
+              }
+              march_tet(tetDist, emit);
+            }
+          }
+        }
+      }
+    });
+
+  std::size_t nFloats = 0;
+  for (const auto& b : perBrick)
+  {
+    nFloats += b.size();
+  }
+
+  result.vertices.reserve(nFloats);
+  for (const auto& b : perBrick)
+  {
+    result.vertices.insert(result.vertices.end(), b.begin(), b.end());
+  }
+
+  result.seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+
+  return result;
+}
+
+/// interactive cut plane, extraction runs on the thread pool
+///
+/// While the plane is being dragged a coarse extraction is computed, once the
+/// interaction stops it is refined at full resolution. At most one extraction
+/// is in flight, intermediate plane positions are skipped.
+struct cutPlaneTool
+{
+  /// stride of the preview extraction during interaction
+  static constexpr std::size_t preview_stride = 4;
+
+  cutPlaneSettings settings;
+  bool enabled = false;
+
+  /// call once per frame on the GL thread
+  void update(std::shared_ptr<const std::vector<structuredZone>> zones,
+              const bool dragging)
+  {
+    if (zones != _zones)
+    {
+      _zones = std::move(zones);
+      _buffer.reset();
+      _shown.reset();
+
+      // start in the center of the new data
+      if (_zones)
+      {
+        aabb bounds;
+        for (const auto& zone : *_zones)
+        {
+          bounds.extend(zone.bounds);
+        }
+        if (bounds.valid())
+        {
+          settings.cut.origin = bounds.center();
+        }
+      }
+    }
+
+    if (_pending.valid() && _pending.wait_for(std::chrono::seconds(0)) ==
+                              std::future_status::ready)
+    {
+      auto result = _pending.get();
+
+      // results computed for a previously loaded file are dropped
+      if (_pendingZones != _zones)
+      {
+        _pendingZones.reset();
+        return;
+      }
+      _pendingZones.reset();
+
+      _shown = result.settings;
+      _stats = { result.vertices.size() / triangleBuffer::floats_per_vertex /
+                   3,
+                 result.nBricksVisited,
+                 result.seconds };
+
+      const trace::scope traceScope{ "upload cut plane", "upload" };
+      _buffer = triangleBuffer{ std::move(result.vertices) };
+    }
+
+    if (!enabled || !_zones || _pending.valid())
+    {
+      return;
+    }
+
+    auto request = settings;
+    request.stride = dragging ? preview_stride : 1;
+
+    if (_shown && is_same(*_shown, request))
+    {
+      return;
+    }
+
+    _pendingZones = _zones;
+    _pending = default_pool().submit(
+      [zones = _zones, request]
+      { return extract_cut_plane(*zones, request); });
+  }
+
+  void render(const shader& shader)
+  {
+    if (enabled && _buffer)
+    {
+      _buffer->draw(shader);
+    }
+  }
+
+  /// triangles, visited bricks and seconds of the last shown extraction
+  struct stats
+  {
+    std::size_t nTriangles = 0;
+    std::size_t nBricksVisited = 0;
+    double seconds = 0.0;
+  };
+
+  const stats& last_stats() const noexcept { return _stats; }
+
+  bool busy() const noexcept { return _pending.valid(); }
+
+private:
+  std::shared_ptr<const std::vector<structuredZone>> _zones;
+  std::shared_ptr<const std::vector<structuredZone>> _pendingZones;
+  std::future<cutPlaneResult> _pending;
+  std::optional<cutPlaneSettings> _shown;
+  std::optional<triangleBuffer> _buffer;
+  stats _stats;
+
+  static bool is_same(const cutPlaneSettings& a, const cutPlaneSettings& b)
+  {
+    return a.cut == b.cut && a.field == b.field && a.stride == b.stride;
+  }
+};
+
+} // namespace cgns_tools::gui
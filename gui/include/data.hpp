@@ -3,16 +3,383 @@
 
 #pragma once
 
+#include "coordinateReader.hpp"
+#include "memory.hpp"
 #include "shader.hpp"
+#include "spatialOrder.hpp"
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include "treeReader.hpp"
 #include "vertexBuffer.hpp"
+#include <algorithm>
 #include <array>
 #include <cgns-tools.hpp>
+#include <chrono>
+#include <filesystem>
+#include <future>
 #include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace cgns_tools::gui
 {
 
+/// CGNS file read and converted without touching OpenGL, so that it can be
+/// prepared on a worker thread and handed to data::load
+struct meshFile
+{
+  std::string path;
+  root tree;
+  std::shared_ptr<const std::vector<structuredZone>> zones;
+  /// point coordinates of all structured zones, xyz interleaved
+  std::vector<float> vertices;
+  /// duration of read and conversion
+  double seconds;
+  /// array bytes read from the file before conversion, and the duration,
+  /// see read_file_tree
+  std::size_t readBytes;
+  double readSeconds;
+  /// accounts the tree to memory::category::tree
+  memory::allocation treeMemory;
+  /// per zone memory, the gpu part as uploaded by data::load
+  std::vector<memory::zoneUsage> usage;
+};
+
+/// append the points of a zone in upload order, xyz interleaved
+inline void
+append_vertices(std::vector<float>& vertices, const structuredZone& zone)
+{
+  if (zone.order.empty())
+  {
+    for (const auto& p : zone.points)
+    {
+      vertices.insert(vertices.end(), { p.x, p.y, p.z });
+    }
+    return;
+  }
+
+  for (const auto n : zone.order)
+  {
+    const auto& p = zone.points[n];
+    vertices.insert(vertices.end(), { p.x, p.y, p.z });
+  }
+}
+
+/// read a CGNS file and convert the structured zones of the first base,
+/// with reorder the points are uploaded along a space-filling curve
+///
+/// The coordinate arrays of the tree are released after conversion. With
+/// compression the fields are kept compressed and the solution arrays are
+/// released as well, the tree then only holds the names.
+inline meshFile
+read_mesh_file(const std::string& path,
+               const bool reorder = false,
+               const compressionSettings& compression = {})
+{
+  const trace::scope traceScope{ "read mesh file", "io" };
+  const auto start = std::chrono::steady_clock::now();
+
+  auto file = read_file_tree(path);
+  auto& tree = file.tree;
+
+  auto zones = std::make_shared<std::vector<structuredZone>>();
+  std::size_t treeBytes = 0;
+  std::vector<memory::zoneUsage> usage;
+  if (!tree.bases.empty())
+  {
+    const trace::scope convertScope{ "convert zones", "convert" };
+    for (auto& zone : tree.bases[0].zones)
+    {
+      if (auto* structured = std::get_if<zoneStructured>(&zone))
+      {
+        std::vector<glm::vec3> points;
+        if (file.coordinates)
+        {
+          points = file.coordinates->take(structured->name);
+        }
+
+        auto& converted = zones->emplace_back(
+          make_structured_zone(*structured, std::move(points)));
+        if (reorder)
+        {
+          converted.order = spatial_order(converted);
+          converted.account_memory();
+        }
+        compress_fields(converted, compression);
+        if (compression.enabled)
+        {
+          release_arrays(*structured);
+        }
+        else
+        {
+          release_coordinates(*structured);
+        }
+
+        const auto bytes = tree_bytes(*structured);
+        treeBytes += bytes;
+        usage.push_back({ converted.name,
+                          bytes,
+                          converted.size_bytes(),
+                          3 * sizeof(float) * converted.points.size() });
+      }
+    }
+  }
+
+  std::size_t nPoints = 0;
+  for (const auto& zone : *zones)
+  {
+    nPoints += zone.points.size();
+  }
+
+  std::vector<float> vertices;
+  vertices.reserve(3 * nPoints);
+
+  for (const auto& zone : *zones)
+  {
+    append_vertices(vertices, zone);
+  }
+
+  const auto seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+
+  return meshFile{ path,
+                   std::move(tree),
+                   std::move(zones),
+                   std::move(vertices),
+                   seconds,
+                   file.bytes,
+                   file.seconds,
+                   { memory::category::tree, treeBytes },
+                   std::move(usage) };
+}
+
+/// changed points of a zone, xyz interleaved
+struct vertexRange
+{
+  std::size_t offset; ///< first float in the vertices of the file
+  std::vector<float> values;
+};
+
+/// CGNS file re-read after it changed on disk, see reload_mesh_file
+struct meshReload
+{
+  /// tree and zones, the vertices are only set for a full reload
+  meshFile file;
+  /// the zones changed in name or size, all points are uploaded again
+  bool full = false;
+  /// points of zones with changed coordinates
+  std::vector<vertexRange> ranges;
+  /// coordinate and vertex field arrays, and those that changed
+  std::size_t nArrays = 0;
+  std::size_t nChanged = 0;
+  /// modification time of the file, the start of the update latency
+  std::chrono::system_clock::time_point written;
+};
+
+/// re-read a file and convert only the arrays that changed
+///
+/// The tree is read as by read_mesh_file, without the parallel point reads.
+/// The coordinate and field arrays of the tree are compared with the
+/// previous zones by content hash before anything is converted. Unchanged
+/// points keep the previous points and bricks, unchanged fields their
+/// values, and viewer derived fields are kept while the points are
+/// unchanged. A zone with a different name or size is converted anew and
+/// causes a full upload. Zones keep the upload order of the previous zones,
+/// see read_mesh_file. The coordinate arrays of the tree are released, with
+/// compression fields not yet compressed are compressed and the solution
+/// arrays released as well.
+inline meshReload
+reload_mesh_file(const std::string& path,
+                 const std::vector<structuredZone>& previous,
+                 const compressionSettings& compression = {})
+{
+  const trace::scope traceScope{ "reload mesh file", "io" };
+  const auto start = std::chrono::steady_clock::now();
+
+  meshReload result;
+  std::error_code ec;
+  const auto written = std::filesystem::last_write_time(path, ec);
+  result.written = ec ? std::chrono::system_clock::now()
+                      : std::chrono::file_clock::to_sys(written);
+
+  // the points are only converted where the coordinate hashes differ
+  auto file = read_file_tree(path, false);
+  auto& tree = file.tree;
+
+  const bool reorder =
+    std::any_of(previous.begin(),
+                previous.end(),
+                [](const structuredZone& zone) { return !zone.order.empty(); });
+
+  const trace::scope convertScope{ "convert changed arrays", "convert" };
+  auto zones = std::make_shared<std::vector<structuredZone>>();
+  std::size_t treeBytes = 0;
+  std::vector<memory::zoneUsage> usage;
+  std::size_t offset = 0;
+
+  std::vector<zoneStructured*> structuredZones;
+  if (!tree.bases.empty())
+  {
+    for (auto& zone : tree.bases[0].zones)
+    {
+      if (auto* structured = std::get_if<zoneStructured>(&zone))
+      {
+        structuredZones.push_back(structured);
+      }
+    }
+  }
+
+  for (auto* structured : structuredZones)
+  {
+    const std::size_t iZone = zones->size();
+    const auto dims = zone_dims(*structured);
+    const structuredZone* before = nullptr;
+    if (iZone < previous.size() && previous[iZone].name == structured->name &&
+        previous[iZone].dims == dims)
+    {
+      before = &previous[iZone];
+    }
+
+    if (!before)
+    {
+      result.full = true;
+      auto& converted = zones->emplace_back(make_structured_zone(*structured));
+      if (reorder)
+      {
+        converted.order = spatial_order(converted);
+        converted.account_memory();
+      }
+    }
+    else
+    {
+      auto& next = zones->emplace_back();
+      next.name = structured->name;
+      next.dims = dims;
+      next.order = before->order;
+
+      const std::size_t nPoints = next.n_points();
+      const auto pointsHash = coordinates_hash(*structured);
+      result.nArrays += 3;
+
+      if (pointsHash == before->pointsHash)
+      {
+        next.points = before->points;
+        next.bricks = before->bricks;
+        next.bounds = before->bounds;
+        next.quality = before->quality;
+      }
+      else
+      {
+        result.nChanged += 3;
+        next.points = convert_points(*structured, nPoints);
+        build_bricks(next);
+
+        auto& range = result.ranges.emplace_back();
+        range.offset = offset;
+        range.values.reserve(3 * nPoints);
+        append_vertices(range.values, next);
+      }
+      next.pointsHash = pointsHash;
+
+      for (const auto& flowSolution : structured->flowSolutions)
+      {
+        for (const auto& dataArray : flowSolution.dataArrays)
+        {
+          if (nPoints == 0 || array_size(dataArray) != nPoints)
+          {
+            continue;
+          }
+          ++result.nArrays;
+
+          const auto name = array_name(dataArray);
+          const auto hash = array_hash(dataArray);
+          // brick ranges depend on the values only, not on the points
+          if (const auto* field = before->field(name);
+              field && field->hash == hash)
+          {
+            next.fields.push_back(*field);
+            continue;
+          }
+
+          ++result.nChanged;
+          auto& converted = next.fields.emplace_back(convert_field(dataArray));
+          build_brick_ranges(next, converted);
+        }
+      }
+
+      // quality and other derived fields depend on the points only
+      if (pointsHash == before->pointsHash)
+      {
+        for (const auto& field : before->fields)
+        {
+          if (field.hash == 0)
+          {
+            next.fields.push_back(field);
+          }
+        }
+      }
+
+      next.account_memory();
+    }
+
+    auto& converted = zones->back();
+    compress_fields(converted, compression);
+    if (compression.enabled)
+    {
+      release_arrays(*structured);
+    }
+    else
+    {
+      release_coordinates(*structured);
+    }
+
+    const auto bytes = tree_bytes(*structured);
+    treeBytes += bytes;
+    usage.push_back({ converted.name,
+                      bytes,
+                      converted.size_bytes(),
+                      3 * sizeof(float) * converted.points.size() });
+    offset += 3 * converted.points.size();
+  }
+
+  if (zones->size() != previous.size())
+  {
+    result.full = true;
+  }
+
+  std::vector<float> vertices;
+  if (result.full)
+  {
+    result.ranges.clear();
+    vertices.reserve(offset);
+    for (const auto& zone : *zones)
+    {
+      append_vertices(vertices, zone);
+    }
+  }
+
+  const auto seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+
+  result.file = meshFile{ path,
+                          std::move(tree),
+                          std::move(zones),
+                          std::move(vertices),
+                          seconds,
+                          file.bytes,
+                          file.seconds,
+                          { memory::category::tree, treeBytes },
+                          std::move(usage) };
+  return result;
+}
+
 struct data
 {
 
@@ -46,7 +413,7 @@ struct data
   //   _vertexBuffer = cgns_tools::gui::vertexBuffer{ std::move(vertices) };
   // }
 
-  data(const glm::vec3 color = { 1.0, 0.0, 0.0 },
+  data(const glm::vec3 color = { 1.0, 0.5, 0.2 },
        const float roughness = 0.2,
        const float metallic = 0.1)
     : _color{ color }
@@ -54,80 +421,57 @@ struct data
     , _metallic{ metallic }
     , _file{}
     , _data{}
+    , _treeMemory{}
+    , _zones{}
     , _vertexBuffer{}
   {
   }
 
-  void loadFile(const std::string& path)
-  {
-    _file = path;
-
-    cgns_tools::fileIn f{ _file };
-    _data = cgns_tools::root{ f.readBaseInformation() };
-
-    const auto& base = (*_data).bases[0];
+  /// read and upload on the calling thread
+  void loadFile(const std::string& path) { load(read_mesh_file(path)); }
 
-    const auto& zone = std::get<cgns_tools::zoneStructured>(base.zones[0]);
-
-    const auto& gridCoordinates = zone.gridCoordinates[0];
-
-    assert(gridCoordinates.dataArrays.size() == 3);
-
-    std::vector<float> vertices;
-
-    const unsigned nPoints =
-      std::visit([](auto&& dataArray) { return dataArray.data.size(); },
-                 gridCoordinates.dataArrays[0]);
-
-    // std::array<float, 3> min{ std::numeric_limits<float>::max(),
-    //                           std::numeric_limits<float>::max(),
-    //                           std::numeric_limits<float>::max() };
-    // std::array<float, 3> max{ std::numeric_limits<float>::min(),
-    //                           std::numeric_limits<float>::min(),
-    //                           std::numeric_limits<float>::min() };
+  /// take over a file read by read_mesh_file, requires the GL context
+  void load(meshFile file)
+  {
+    _file = std::move(file.path);
+    _data = std::move(file.tree);
+    _zones = std::move(file.zones);
+    _treeMemory = std::move(file.treeMemory);
+    memory::set_zones(std::move(file.usage));
+
+    const trace::scope traceScope{ "upload points", "upload" };
+    _vertexBuffer =
+      cgns_tools::gui::vertexBuffer{ std::move(file.vertices) };
+    _vertexBuffer->set_grid_zones(grid_zones());
+  }
 
-    for (unsigned iVert = 0; iVert < nPoints; ++iVert)
+  /// take over a re-read of the current file, uploads only the changed
+  /// points unless the zone layout changed, requires the GL context
+  void reload(meshReload update)
+  {
+    if (update.full || !_vertexBuffer)
     {
-      for (unsigned iCoord = 0; iCoord < gridCoordinates.dataArrays.size();
-           ++iCoord)
-      {
-        float x = std::visit([iVert](const auto& dataArray) -> float
-                             { return dataArray.data[iVert]; },
-                             gridCoordinates.dataArrays[iCoord]);
-
-        if (iCoord == 0)
-        {
-          x /= 10;
-        }
-        else if (iCoord == 1)
-        {
-          x *= 10;
-        }
-        else if (iCoord == 2)
-        {
-          x /= 10;
-        }
-
-        // if (x < min[iCoord])
-        // {
-        //   min[iCoord] = x;
-        // }
+      load(std::move(update.file));
+      return;
+    }
 
-        // if (x > max[iCoord])
-        // {
-        //   max[iCoord] = x;
-        // }
+    _data = std::move(update.file.tree);
+    _zones = std::move(update.file.zones);
+    _treeMemory = std::move(update.file.treeMemory);
+    memory::set_zones(std::move(update.file.usage));
 
-        vertices.emplace_back(x);
-      }
+    const trace::scope traceScope{ "upload changed points", "upload" };
+    for (const auto& range : update.ranges)
+    {
+      _vertexBuffer->update(
+        range.offset, range.values.data(), range.values.size());
     }
-
-    _vertexBuffer = cgns_tools::gui::vertexBuffer{ std::move(vertices) };
   }
 
   void update(shader& shader)
   {
-    // shader.set_vec3(_color, "albedo");
+    shader.use();
+    shader.set_vec3(_color, "albedo");
     // shader.set_f1(_roughness, "roughness");
     // shader.set_f1(_metallic, "metallic");
     // shader.set_f1(1.0f, "ao");
@@ -136,18 +480,92 @@ struct data
   // operator bool() { return _data.has_value(); }
   operator bool() { return _vertexBuffer.has_value(); }
 
-  void render(const shader& shader)
+  /// draw the points, of spatially ordered zones only the leading fraction,
+  /// i.e. a uniform subsample, see spatial_order
+  void render(const shader& shader, const float fraction = 1.0f)
   {
-    if (_vertexBuffer)
+    if (!_vertexBuffer)
+    {
+      return;
+    }
+    if (fraction >= 1.0f || !_zones)
     {
       _vertexBuffer->draw(shader);
+      return;
+    }
+
+    std::vector<GLint> first;
+    std::vector<GLsizei> counts;
+    std::size_t firstPoint = 0;
+    for (const auto& zone : *_zones)
+    {
+      const std::size_t n = zone.n_points();
+      first.push_back(GLint(firstPoint));
+      counts.push_back(GLsizei(
+        zone.order.empty() ? n : std::max<std::size_t>(fraction * n, 1)));
+      firstPoint += n;
+    }
+    _vertexBuffer->draw(shader, first, counts);
+  }
+
+  /// draw the grid lines of all zones, every stride-th line per direction,
+  /// returns the number of zones skipped as too large for the driver
+  std::size_t render_grid_lines(const shader& shader, const std::size_t stride)
+  {
+    std::size_t nSkipped = 0;
+    if (_vertexBuffer && _zones)
+    {
+      for (std::size_t iZone = 0; iZone < _zones->size(); ++iZone)
+      {
+        if (!_vertexBuffer->draw_grid_lines(shader, iZone, stride))
+        {
+          ++nSkipped;
+        }
+      }
     }
+    return nSkipped;
   }
 
   const auto& file() noexcept { return _file; }
 
   const auto& operator()() { return _data; }
 
+  /// replace the zones by zones with the same points, e.g. with derived
+  /// fields, the uploaded vertices are kept
+  void set_zones(std::shared_ptr<const std::vector<structuredZone>> zones)
+  {
+    auto usage = memory::zones();
+    for (auto& u : usage)
+    {
+      for (const auto& zone : *zones)
+      {
+        if (zone.name == u.name)
+        {
+          u.zone = zone.size_bytes();
+        }
+      }
+    }
+    memory::set_zones(std::move(usage));
+    _zones = std::move(zones);
+  }
+
+  /// structured zones of the first base, shared with background tasks
+  const auto& zones() const noexcept { return _zones; }
+
+  /// bounds of all structured zones
+  aabb bounds() const
+  {
+    aabb result;
+    if (_zones)
+    {
+      for (const auto& zone : *_zones)
+      {
+        result.extend(zone.bounds);
+      }
+    }
+    return result;
+  }
+
 private:
   glm::vec3 _color;
   float _roughness;
@@ -155,7 +573,27 @@ private:
 
   std::string _file;
   std::optional<root> _data;
+  memory::allocation _treeMemory;
+  std::shared_ptr<const std::vector<structuredZone>> _zones;
   std::optional<vertexBuffer> _vertexBuffer;
+
+  /// layout of the structured zones in the vertex buffer
+  std::vector<gridZone> grid_zones() const
+  {
+    std::vector<gridZone> result;
+    if (_zones)
+    {
+      // zones are uploaded back to back, see read_mesh_file
+      std::size_t firstPoint = 0;
+      for (const auto& zone : *_zones)
+      {
+        result.push_back(
+          { firstPoint, zone.dims, { zone.order.data(), zone.order.size() } });
+        firstPoint += zone.n_points();
+      }
+    }
+    return result;
+  }
 };
 
 } // namespace cgns_tools::gui
\ No newline at end of file
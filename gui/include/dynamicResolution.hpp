@@ -0,0 +1,187 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "helpers.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+namespace cgns_tools::gui
+{
+
+/// render scale of the viewer that keeps the scene below a target time while
+/// the user interacts
+///
+/// The GPU time of the scene is measured with timer queries that are read
+/// back a few frames later, so the measurement never stalls the pipeline.
+/// Scene time is taken as proportional to the pixel count: above the target
+/// the scale shrinks to meet it, well below the target it grows again. When
+/// the interaction ends the scale returns to one after a short hold, so still
+/// images are always rendered at full resolution.
+struct dynamicResolution
+{
+  /// scale values kept for display
+  static constexpr std::size_t history_size = 120;
+
+  bool enabled = true;
+  double targetSeconds = 1.0 / 60.0;
+  float minScale = 0.25f;
+
+  /// constructor, requires a current GL context
+  dynamicResolution()
+    : _queries{}
+    , _scales{}
+    , _pending{}
+    , _next{ 0 }
+    , _skipped{ false }
+    , _scale{ 1.0f }
+    , _target{ 1.0f }
+    , _sceneSeconds{ 0.0 }
+    , _lastInteraction{}
+    , _history{}
+    , _historyNext{ 0 }
+  {
+    opengl_fn<glGenQueries>(GLsizei(_queries.size()), _queries.data());
+    _history.fill(1.0f);
+  }
+
+  /// destructor
+  ~dynamicResolution()
+  {
+    opengl_fn<glDeleteQueries>(GLsizei(_queries.size()), _queries.data());
+  }
+
+  dynamicResolution(const dynamicResolution& other) = delete;
+  dynamicResolution& operator=(const dynamicResolution& other) = delete;
+
+  /// scale for the next scene, call once per frame before rendering it
+  ///
+  /// interacting is true while the view changes, e.g. during camera drags,
+  /// frames that are captured are always rendered at full resolution.
+  float update(const bool interacting, const bool capturing)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    if (interacting)
+    {
+      _lastInteraction = now;
+    }
+
+    // results of finished queries, oldest first
+    for (std::size_t n = 0; n < _queries.size(); ++n)
+    {
+      const std::size_t i = (_next + n) % _queries.size();
+      if (!_pending[i])
+      {
+        continue;
+      }
+
+      GLint available = 0;
+      opengl_fn<glGetQueryObjectiv>(
+        _queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+      {
+        break;
+      }
+
+      GLuint64 nanoseconds = 0;
+      opengl_fn<glGetQueryObjectui64v>(
+        _queries[i], GL_QUERY_RESULT, &nanoseconds);
+      _pending[i] = false;
+      _sceneSeconds = 1e-9 * double(nanoseconds);
+
+      // relative to the scale the measured frame was rendered with
+      if (_sceneSeconds > 0.0)
+      {
+        const float ideal =
+          _scales[i] * float(std::sqrt(targetSeconds / _sceneSeconds));
+        _target = _sceneSeconds > targetSeconds
+                    ? std::min(ideal, _target)
+                    : std::min(ideal, _target * grow);
+        if (_sceneSeconds > shrink_threshold * targetSeconds)
+        {
+          _target = std::min(_target, _scales[i]);
+        }
+      }
+    }
+    _target = std::clamp(_target, minScale, 1.0f);
+
+    const bool active = now - _lastInteraction < hold;
+    _scale = enabled && active && !capturing ? _target : 1.0f;
+
+    _history[_historyNext] = _scale;
+    _historyNext = (_historyNext + 1) % history_size;
+    return _scale;
+  }
+
+  /// start timing the scene
+  void begin()
+  {
+    if (_pending[_next])
+    {
+      // oldest query still in flight, skip timing this frame
+      _skipped = true;
+      return;
+    }
+    _skipped = false;
+    opengl_fn<glBeginQuery>(GL_TIME_ELAPSED, _queries[_next]);
+  }
+
+  /// stop timing the scene
+  void end()
+  {
+    if (_skipped)
+    {
+      return;
+    }
+    opengl_fn<glEndQuery>(GL_TIME_ELAPSED);
+    _scales[_next] = _scale;
+    _pending[_next] = true;
+    _next = (_next + 1) % _queries.size();
+  }
+
+  float scale() const noexcept { return _scale; }
+
+  /// GPU time of the last measured scene
+  double scene_seconds() const noexcept { return _sceneSeconds; }
+
+  /// scales of the last frames in a ring buffer, see history_offset
+  const std::array<float, history_size>& history() const noexcept
+  {
+    return _history;
+  }
+
+  /// index of the oldest value in history
+  std::size_t history_offset() const noexcept { return _historyNext; }
+
+private:
+  /// queries in flight, results are typically available after two frames
+  static constexpr std::size_t n_queries = 4;
+  /// growth of the scale per measurement below the target
+  static constexpr float grow = 1.05f;
+  /// scene time relative to the target above which the scale never grows
+  static constexpr double shrink_threshold = 0.8;
+  /// time after the last interaction until full resolution
+  static constexpr std::chrono::milliseconds hold{ 250 };
+
+  std::array<GLuint, n_queries> _queries;
+  std::array<float, n_queries> _scales;
+  std::array<bool, n_queries> _pending;
+  std::size_t _next;
+  bool _skipped;
+
+  float _scale;
+  float _target; ///< scale while interacting
+  double _sceneSeconds;
+  std::chrono::steady_clock::time_point _lastInteraction;
+
+  std::array<float, history_size> _history;
+  std::size_t _historyNext;
+};
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,179 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+#ifdef __linux__
+#include <array>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace cgns_tools::gui
+{
+
+/// reports rewrites of a file once the writer has finished
+///
+/// On Linux the directory is watched with inotify: a rewrite is complete
+/// when the writer closes the file (IN_CLOSE_WRITE) or renames a finished
+/// file onto it (IN_MOVED_TO). Elsewhere the modification time is polled
+/// and a change counts once time and size are stable for one interval.
+/// Events closer than settle are reported once, e.g. for writers that open
+/// the file several times per output.
+struct fileWatcher
+{
+  static constexpr std::chrono::milliseconds settle{ 50 };
+
+  /// constructor
+  explicit fileWatcher(std::filesystem::path path)
+    : _path{ std::move(path) }
+    , _pending{ false }
+    , _last{}
+    , _stamp{ stamp() }
+#ifdef __linux__
+    , _fd{ inotify_init1(IN_NONBLOCK | IN_CLOEXEC) }
+#endif
+  {
+#ifdef __linux__
+    if (_fd >= 0)
+    {
+      const auto directory = _path.has_parent_path()
+                               ? _path.parent_path()
+                               : std::filesystem::path{ "." };
+      if (inotify_add_watch(
+            _fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+      {
+        close(_fd);
+        _fd = -1;
+      }
+    }
+#endif
+  }
+
+  /// destructor
+  ~fileWatcher()
+  {
+#ifdef __linux__
+    if (_fd >= 0)
+    {
+      close(_fd);
+    }
+#endif
+  }
+
+  fileWatcher(const fileWatcher& other) = delete;
+  fileWatcher& operator=(const fileWatcher& other) = delete;
+
+  /// true once per completed rewrite, call once per frame
+  bool poll()
+  {
+    const auto now = std::chrono::steady_clock::now();
+
+#ifdef __linux__
+    if (_fd >= 0)
+    {
+      if (drain())
+      {
+        _pending = true;
+        _last = now;
+      }
+    }
+    else
+#endif
+    {
+      if (now - _last >= poll_interval)
+      {
+        // a stamp equal to the previous poll means the writer is done
+        const auto current = stamp();
+        if (current != _stamp)
+        {
+          _stamp = current;
+          _pending = true;
+        }
+        else if (_pending)
+        {
+          _pending = false;
+          _last = now;
+          return true;
+        }
+        _last = now;
+      }
+      return false;
+    }
+
+    if (_pending && now - _last >= settle)
+    {
+      _pending = false;
+      return true;
+    }
+    return false;
+  }
+
+  const std::filesystem::path& path() const noexcept { return _path; }
+
+private:
+  static constexpr std::chrono::milliseconds poll_interval{ 500 };
+
+  struct fileStamp
+  {
+    std::filesystem::file_time_type time{};
+    std::uintmax_t size = 0;
+
+    bool operator==(const fileStamp& other) const = default;
+  };
+
+  std::filesystem::path _path;
+  bool _pending;
+  std::chrono::steady_clock::time_point _last;
+  fileStamp _stamp;
+#ifdef __linux__
+  int _fd;
+#endif
+
+  fileStamp stamp() const
+  {
+    std::error_code ec;
+    fileStamp result;
+    result.time = std::filesystem::last_write_time(_path, ec);
+    result.size = std::filesystem::file_size(_path, ec);
+    return result;
+  }
+
+#ifdef __linux__
+  /// read all queued events, true if one concerns the file
+  bool drain()
+  {
+    const auto name = _path.filename().string();
+    bool found = false;
+
+    alignas(inotify_event) std::array<char, 4096> buffer;
+    while (true)
+    {
+      const auto n = read(_fd, buffer.data(), buffer.size());
+      if (n <= 0)
+      {
+        return found;
+      }
+
+      for (ssize_t offset = 0; offset < n;)
+      {
+        const auto* event =
+          reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+        if (event->len > 0 && name == event->name)
+        {
+          found = true;
+        }
+        offset += sizeof(inotify_event) + event->len;
+      }
+    }
+  }
+#endif
+};
+
+} // namespace cgns_tools::gui
@@ -5,6 +5,10 @@
 
 #include "helpers.hpp"
 #include "log.hpp"
+#include "memory.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstdint>
 #include <glad/glad.h>
 #include <ostream>
@@ -19,9 +23,12 @@ struct frameBuffer
   frameBuffer(const int32_t width = 800, const int32_t height = 600)
     : _fbo{ 0 }
     , _textureId{ 0 }
-    , _renderBufferId{ 0 }
+    , _depthTextureId{ 0 }
     , _width{ width }
     , _height{ height }
+    , _renderWidth{ width }
+    , _renderHeight{ height }
+    , _memory{}
   {
     create_buffers();
   }
@@ -30,12 +37,42 @@ struct frameBuffer
 
   auto get_texture() { return _textureId; }
 
+  /// depth of the rendered scene, e.g. for rays that end at the geometry
+  auto get_depth_texture() const { return _depthTextureId; }
+
+  auto get_fbo() const { return _fbo; }
+
+  int32_t width() const noexcept { return _width; }
+
+  int32_t height() const noexcept { return _height; }
+
+  /// size of the region rendered by bind, at most the allocated size
+  int32_t render_width() const noexcept { return _renderWidth; }
+
+  int32_t render_height() const noexcept { return _renderHeight; }
+
+  /// render into the lower left scale * size pixels, the attachments are
+  /// kept, see uv_max for showing the region
+  void set_render_scale(const float scale)
+  {
+    _renderWidth = std::clamp(int32_t(std::lround(scale * _width)), 1, _width);
+    _renderHeight =
+      std::clamp(int32_t(std::lround(scale * _height)), 1, _height);
+  }
+
+  /// texture coordinates of the upper right corner of the rendered region
+  std::array<float, 2> uv_max() const
+  {
+    return { float(_renderWidth) / float(_width),
+             float(_renderHeight) / float(_height) };
+  }
+
   void unbind() const { opengl_fn<glBindFramebuffer>(GL_FRAMEBUFFER, 0); }
 
   void bind()
   {
     opengl_fn<glBindFramebuffer>(GL_FRAMEBUFFER, _fbo);
-    opengl_fn<glViewport>(0, 0, _width, _height);
+    opengl_fn<glViewport>(0, 0, _renderWidth, _renderHeight);
     opengl_fn<glClear>(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   }
 
@@ -49,15 +86,21 @@ struct frameBuffer
     delete_buffers();
     _width = width;
     _height = height;
+    _renderWidth = width;
+    _renderHeight = height;
     create_buffers();
   }
 
 private:
   uint32_t _fbo;
   uint32_t _textureId;
-  uint32_t _renderBufferId;
+  uint32_t _depthTextureId;
   int32_t _width;
   int32_t _height;
+  int32_t _renderWidth;
+  int32_t _renderHeight;
+
+  memory::allocation _memory;
 
 private:
   void create_buffers()
@@ -88,16 +131,32 @@ private:
     opengl_fn<glFramebufferTexture2D>(
       GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _textureId, 0);
 
-    // create depth & stencil renderbuffer
-    opengl_fn<glGenRenderbuffers>(1, &_renderBufferId);
-    opengl_fn<glBindRenderbuffer>(GL_RENDERBUFFER, _renderBufferId);
-    opengl_fn<glRenderbufferStorage>(
-      GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, _width, _height);
-    opengl_fn<glBindRenderbuffer>(GL_RENDERBUFFER, 0);
-    opengl_fn<glFramebufferRenderbuffer>(GL_FRAMEBUFFER,
-                                         GL_DEPTH_STENCIL_ATTACHMENT,
-                                         GL_RENDERBUFFER,
-                                         _renderBufferId);
+    // create depth & stencil texture, a texture so that it can be sampled
+    opengl_fn<glGenTextures>(1, &_depthTextureId);
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, _depthTextureId);
+    opengl_fn<glTexImage2D>(GL_TEXTURE_2D,
+                            0,
+                            GL_DEPTH24_STENCIL8,
+                            _width,
+                            _height,
+                            0,
+                            GL_DEPTH_STENCIL,
+                            GL_UNSIGNED_INT_24_8,
+                            nullptr);
+    opengl_fn<glTexParameteri>(
+      GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    opengl_fn<glTexParameteri>(
+      GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, 0);
+    opengl_fn<glFramebufferTexture2D>(GL_FRAMEBUFFER,
+                                      GL_DEPTH_STENCIL_ATTACHMENT,
+                                      GL_TEXTURE_2D,
+                                      _depthTextureId,
+                                      0);
+
+    // RGBA8 color and 24 bit depth with 8 bit stencil
+    _memory.reset(memory::category::framebuffers,
+                  8 * std::size_t(_width) * std::size_t(_height));
 
     // check for completeness
     int32_t completeStatus =
@@ -118,11 +177,11 @@ private:
     if (_fbo)
     {
       opengl_fn<glDeleteFramebuffers>(1, &_fbo);
-      // opengl_fn<glDeleteTextures>(1, &_textureId);
-      // opengl_fn<glDeleteRenderbuffers>(1, &_renderBufferId);
+      opengl_fn<glDeleteTextures>(1, &_textureId);
+      opengl_fn<glDeleteTextures>(1, &_depthTextureId);
       _fbo = 0;
       _textureId = 0;
-      _renderBufferId = 0;
+      _depthTextureId = 0;
     }
   }
 };
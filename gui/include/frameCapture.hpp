@@ -0,0 +1,240 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "frameBuffer.hpp"
+#include "helpers.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "png.hpp"
+#include "trace.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// asynchronous readback of frame buffer images into PNG files
+///
+/// capture starts a copy of the color attachment into one of ring_size pixel
+/// buffer objects and returns immediately. poll, called once per frame, maps
+/// buffers whose copy has completed on the GPU and hands the pixels to the
+/// pool for encoding, so neither the copy nor the encoding stalls the frame.
+struct frameCapture
+{
+  static constexpr std::size_t ring_size = 3;
+
+  /// encodes in flight before further captures are dropped, bounds memory
+  static constexpr std::size_t max_encoding = 16;
+
+  /// drop captures while max_encoding are queued instead of waiting, keeps
+  /// interactive recording responsive
+  bool dropWhenBusy = true;
+
+  /// constructor
+  frameCapture()
+    : _slots{}
+    , _next{ 0 }
+    , _encoding{}
+    , _nDropped{ 0 }
+    , _nWritten{ 0 }
+  {
+    for (auto& slot : _slots)
+    {
+      opengl_fn<glGenBuffers>(1, &slot.pbo);
+    }
+  }
+
+  /// destructor, finishes pending captures
+  ~frameCapture()
+  {
+    flush();
+    for (auto& slot : _slots)
+    {
+      opengl_fn<glDeleteBuffers>(1, &slot.pbo);
+    }
+  }
+
+  frameCapture(const frameCapture& other) = delete;
+  frameCapture& operator=(const frameCapture& other) = delete;
+
+  /// start reading back the color attachment of fb into path
+  void capture(frameBuffer& fb, std::filesystem::path path)
+  {
+    const trace::scope traceScope{ "capture", "capture" };
+
+    if (_encoding.size() >= max_encoding)
+    {
+      if (dropWhenBusy)
+      {
+        ++_nDropped;
+        return;
+      }
+      _nWritten += _encoding.front().get();
+      _encoding.pop_front();
+    }
+
+    // all buffers in flight, complete the oldest one
+    auto& slot = _slots[_next];
+    if (slot.fence)
+    {
+      finish(slot, true);
+    }
+
+    const auto width = fb.width();
+    const auto height = fb.height();
+    const auto size = 4 * std::size_t(width) * std::size_t(height);
+
+    opengl_fn<glBindBuffer>(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    if (size != slot.size)
+    {
+      opengl_fn<glBufferData>(
+        GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+      slot.size = size;
+      slot.memory.reset(memory::category::gl_buffers, size);
+    }
+
+    opengl_fn<glBindFramebuffer>(GL_READ_FRAMEBUFFER, fb.get_fbo());
+    opengl_fn<glReadPixels>(
+      0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    opengl_fn<glBindFramebuffer>(GL_READ_FRAMEBUFFER, 0);
+    opengl_fn<glBindBuffer>(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = opengl_fn<glFenceSync>(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.path = std::move(path);
+
+    _next = (_next + 1) % ring_size;
+  }
+
+  /// hand completed copies to the encoder, call once per frame
+  void poll()
+  {
+    for (std::size_t i = 0; i < ring_size; ++i)
+    {
+      // complete in capture order
+      auto& slot = _slots[(_next + i) % ring_size];
+      if (slot.fence && !finish(slot, false))
+      {
+        break;
+      }
+    }
+
+    while (!_encoding.empty() &&
+           _encoding.front().wait_for(std::chrono::seconds(0)) ==
+             std::future_status::ready)
+    {
+      _nWritten += _encoding.front().get();
+      _encoding.pop_front();
+    }
+  }
+
+  /// wait for all pending captures to be written
+  void flush()
+  {
+    for (std::size_t i = 0; i < ring_size; ++i)
+    {
+      auto& slot = _slots[(_next + i) % ring_size];
+      if (slot.fence)
+      {
+        finish(slot, true);
+      }
+    }
+
+    for (auto& encoding : _encoding)
+    {
+      _nWritten += encoding.get();
+    }
+    _encoding.clear();
+  }
+
+  /// captures not yet written, in readback or encoding
+  std::size_t pending() const noexcept
+  {
+    std::size_t n = _encoding.size();
+    for (const auto& slot : _slots)
+    {
+      n += slot.fence != nullptr;
+    }
+    return n;
+  }
+
+  std::size_t written() const noexcept { return _nWritten; }
+
+  std::size_t dropped() const noexcept { return _nDropped; }
+
+private:
+  struct slot
+  {
+    GLuint pbo = 0;
+    std::size_t size = 0;
+    GLsync fence = nullptr;
+    int32_t width = 0;
+    int32_t height = 0;
+    std::filesystem::path path;
+    memory::allocation memory;
+  };
+
+  std::array<slot, ring_size> _slots;
+  std::size_t _next;
+  std::deque<std::future<std::size_t>> _encoding;
+  std::size_t _nDropped;
+  std::size_t _nWritten;
+
+  /// copy the pixels of a slot and submit the encoding, returns false if the
+  /// GPU has not finished the copy and wait is false
+  bool finish(slot& s, const bool wait)
+  {
+    const auto status = opengl_fn<glClientWaitSync>(
+      s.fence,
+      wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+      wait ? GLuint64(1'000'000'000) : GLuint64(0));
+    if (status == GL_TIMEOUT_EXPIRED && !wait)
+    {
+      return false;
+    }
+    opengl_fn<glDeleteSync>(s.fence);
+    s.fence = nullptr;
+
+    const trace::scope traceScope{ "map pixels", "capture" };
+
+    auto pixels = std::make_shared<std::vector<uint8_t>>(s.size);
+    opengl_fn<glBindBuffer>(GL_PIXEL_PACK_BUFFER, s.pbo);
+    if (const auto* mapped = static_cast<const uint8_t*>(
+          opengl_fn<glMapBufferRange>(
+            GL_PIXEL_PACK_BUFFER, 0, s.size, GL_MAP_READ_BIT)))
+    {
+      std::memcpy(pixels->data(), mapped, s.size);
+      opengl_fn<glUnmapBuffer>(GL_PIXEL_PACK_BUFFER);
+    }
+    opengl_fn<glBindBuffer>(GL_PIXEL_PACK_BUFFER, 0);
+
+    _encoding.push_back(default_pool().submit(
+      [pixels, width = s.width, height = s.height, path = s.path]
+      {
+        const trace::scope encodeScope{ "encode png", "capture" };
+        if (!write_png(path, pixels->data(), width, height))
+        {
+          log_error("Failed to write {}", path.string());
+          return std::size_t(0);
+        }
+        return std::size_t(1);
+      }));
+
+    return true;
+  }
+};
+
+} // namespace cgns_tools::gui
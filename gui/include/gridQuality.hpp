@@ -0,0 +1,615 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+enum class qualityMetric : std::size_t
+{
+  volume,       ///< cell volume from the Jacobian at the cell center
+  aspect_ratio, ///< longest over shortest mean edge length
+  skewness,     ///< largest |cos| between the cell axes, 0 is orthogonal
+  jacobian,     ///< smallest scaled Jacobian of the eight corners
+  count
+};
+
+inline constexpr std::size_t n_quality_metrics =
+  std::size_t(qualityMetric::count);
+
+/// names of the metrics, also used as names of the vertex fields
+inline constexpr std::array<const char*, n_quality_metrics>
+  quality_metric_names{ "Cell volume",
+                        "Aspect ratio",
+                        "Skewness",
+                        "Min Jacobian" };
+
+/// cell quality of one structured zone, cached in the zone
+struct zoneQuality
+{
+  /// one value per cell and metric, cell index i + (ni - 1) * (j + ...)
+  std::array<std::vector<float>, n_quality_metrics> cells;
+  std::array<float, n_quality_metrics> min;
+  std::array<float, n_quality_metrics> max;
+  /// cells with a corner Jacobian of opposite sign to the zone
+  std::size_t nNegative = 0;
+
+  /// accounts the cell values to memory::category::caches
+  memory::allocation usage;
+};
+
+/// distribution of one metric over all cells
+struct qualityHistogram
+{
+  static constexpr std::size_t n_bins = 64;
+
+  float min = 0.0f;
+  float max = 0.0f;
+  double mean = 0.0;
+  std::array<uint64_t, n_bins> counts{};
+};
+
+namespace detail
+{
+
+/// corners of up to brick_size consecutive cells along i, structure of
+/// arrays so that the kernel runs over the cells in SIMD lanes
+struct cellRow
+{
+  static constexpr std::size_t width = structuredZone::brick_size;
+
+  /// corner c of cell n is (x, y, z)[c][n], c = di + 2 dj + 4 dk
+  alignas(64) float x[8][width];
+  alignas(64) float y[8][width];
+  alignas(64) float z[8][width];
+};
+
+struct vec
+{
+  float x, y, z;
+};
+
+inline vec
+operator-(const vec a, const vec b)
+{
+  return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+inline vec
+operator+(const vec a, const vec b)
+{
+  return { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+inline float
+dot(const vec a, const vec b)
+{
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline vec
+cross(const vec a, const vec b)
+{
+  return { a.y * b.z - a.z * b.y,
+           a.z * b.x - a.x * b.z,
+           a.x * b.y - a.y * b.x };
+}
+
+/// minimum and maximum of values, unlike std::min and std::max, which
+/// return references, GCC if-converts them at -O2
+inline float
+min_value(const float a, const float b)
+{
+  return b < a ? b : a;
+}
+
+inline float
+max_value(const float a, const float b)
+{
+  return a < b ? b : a;
+}
+
+/// scaled Jacobian of a corner from its edges along +i, +j and +k
+inline float
+scaled_jacobian(const vec a, const vec b, const vec e)
+{
+  constexpr float tiny = std::numeric_limits<float>::min();
+  const float norm =
+    std::sqrt(max_value(dot(a, a) * dot(b, b) * dot(e, e), tiny));
+  return dot(a, cross(b, e)) / norm;
+}
+
+/// all metrics of n cells of a row
+///
+/// The loop body is branch free and reads the corners with unit stride, so
+/// it is vectorized across the cells of the row, at -O2 given -fopenmp-simd.
+inline void
+quality_kernel(const cellRow& r,
+               const std::size_t n,
+               float* __restrict volume,
+               float* __restrict aspectRatio,
+               float* __restrict skewness,
+               float* __restrict jacobian)
+{
+  constexpr float tiny = std::numeric_limits<float>::min();
+
+#pragma omp simd
+  for (std::size_t c = 0; c < n; ++c)
+  {
+    // c by value, a reference would keep it in memory and the loop scalar
+    const auto p = [&r, c](const std::size_t k) -> vec
+    { return { r.x[k][c], r.y[k][c], r.z[k][c] }; };
+
+    // the four edges along i, j and k
+    const vec a0 = p(1) - p(0);
+    const vec a1 = p(3) - p(2);
+    const vec a2 = p(5) - p(4);
+    const vec a3 = p(7) - p(6);
+    const vec b0 = p(2) - p(0);
+    const vec b1 = p(3) - p(1);
+    const vec b2 = p(6) - p(4);
+    const vec b3 = p(7) - p(5);
+    const vec e0 = p(4) - p(0);
+    const vec e1 = p(5) - p(1);
+    const vec e2 = p(6) - p(2);
+    const vec e3 = p(7) - p(3);
+
+    // mean edge vectors, times four
+    const vec ei = (a0 + a1) + (a2 + a3);
+    const vec ej = (b0 + b1) + (b2 + b3);
+    const vec ek = (e0 + e1) + (e2 + e3);
+
+    volume[c] = dot(ei, cross(ej, ek)) * (1.0f / 64.0f);
+
+    const float li = dot(ei, ei);
+    const float lj = dot(ej, ej);
+    const float lk = dot(ek, ek);
+    const float lMax = max_value(li, max_value(lj, lk));
+    const float lMin = max_value(min_value(li, min_value(lj, lk)), tiny);
+    aspectRatio[c] = std::sqrt(lMax / lMin);
+
+    const float dij = dot(ei, ej);
+    const float djk = dot(ej, ek);
+    const float dki = dot(ek, ei);
+    const float cos2 =
+      max_value(dij * dij / max_value(li * lj, tiny),
+                max_value(djk * djk / max_value(lj * lk, tiny),
+                          dki * dki / max_value(lk * li, tiny)));
+    skewness[c] = std::sqrt(cos2);
+
+    jacobian[c] =
+      min_value(min_value(min_value(scaled_jacobian(a0, b0, e0),
+                                    scaled_jacobian(a0, b1, e1)),
+                          min_value(scaled_jacobian(a1, b0, e2),
+                                    scaled_jacobian(a1, b1, e3))),
+                min_value(min_value(scaled_jacobian(a2, b2, e0),
+                                    scaled_jacobian(a2, b3, e1)),
+                          min_value(scaled_jacobian(a3, b2, e2),
+                                    scaled_jacobian(a3, b3, e3))));
+  }
+}
+
+/// add a layer of values along axis, each combines its two neighbors in the
+/// input, or repeats the value at the ends
+template<std::size_t axis>
+std::vector<float>
+filter_layer(const std::vector<float>& in,
+             const std::array<std::size_t, 3>& n,
+             const bool minimum)
+{
+  auto m = n;
+  m[axis] += 1;
+  const std::size_t stride = axis == 0 ? 1 : axis == 1 ? n[0] : n[0] * n[1];
+
+  std::vector<float> out(m[0] * m[1] * m[2]);
+  parallel_for(
+    0,
+    m[2],
+    1,
+    [&](const std::size_t k)
+    {
+      for (std::size_t j = 0; j < m[1]; ++j)
+      {
+        std::array<std::size_t, 3> x{ 0, j, k };
+        for (std::size_t i = 0; i < m[0]; ++i)
+        {
+          x[0] = i;
+          const std::size_t xa = x[axis];
+          auto x0 = x;
+          x0[axis] = xa > 0 ? xa - 1 : 0;
+
+          const std::size_t at = x0[0] + n[0] * (x0[1] + n[1] * x0[2]);
+          const float a = in[at];
+          const float b = in[xa > 0 && xa < n[axis] ? at + stride : at];
+
+          out[i + m[0] * (j + m[1] * k)] =
+            minimum ? std::min(a, b) : 0.5f * (a + b);
+        }
+      }
+    });
+  return out;
+}
+
+/// vertex field of a cell metric, the mean of the adjacent cells, or their
+/// minimum for the Jacobian so that inverted cells stay visible
+///
+/// Both are separable, the cells are filtered along i, j and k in turn.
+inline scalarField
+vertex_field(const structuredZone& zone,
+             const std::vector<float>& cells,
+             const qualityMetric metric)
+{
+  scalarField field;
+  field.name = quality_metric_names[std::size_t(metric)];
+
+  std::vector<float> values;
+  if (zone.n_cells() == 0)
+  {
+    values.assign(zone.n_points(), 0.0f);
+  }
+  else
+  {
+    const bool minimum = metric == qualityMetric::jacobian;
+    std::array<std::size_t, 3> n{ zone.dims[0] - 1,
+                                  zone.dims[1] - 1,
+                                  zone.dims[2] - 1 };
+    values = filter_layer<0>(cells, n, minimum);
+    n[0] += 1;
+    values = filter_layer<1>(values, n, minimum);
+    n[1] += 1;
+    values = filter_layer<2>(values, n, minimum);
+  }
+
+  const auto [min, max] = std::minmax_element(values.begin(), values.end());
+  field.min = *min;
+  field.max = *max;
+  field.values = std::move(values);
+  build_brick_ranges(zone, field);
+  return field;
+}
+
+} // namespace detail
+
+/// compute all quality metrics of the cells of a zone, in parallel over its
+/// bricks and in SIMD lanes over the cells of a brick row
+///
+/// Volumes and Jacobians are flipped for left handed zones, so that negative
+/// values always mark cells inverted with respect to the zone.
+inline zoneQuality
+compute_zone_quality(const structuredZone& zone)
+{
+  const trace::scope traceScope{ "zone quality", "quality" };
+
+  zoneQuality result;
+  const std::size_t nCells = zone.n_cells();
+  for (auto& cells : result.cells)
+  {
+    cells.resize(nCells);
+  }
+  result.min.fill(0.0f);
+  result.max.fill(0.0f);
+  if (nCells == 0)
+  {
+    return result;
+  }
+
+  const std::size_t ni = zone.dims[0] - 1;
+  const std::size_t nj = zone.dims[1] - 1;
+  std::vector<double> brickVolume(zone.bricks.size(), 0.0);
+
+  parallel_for(
+    0,
+    zone.bricks.size(),
+    1,
+    [&](const std::size_t iBrick)
+    {
+      const auto& brick = zone.bricks[iBrick];
+      const std::size_t n = brick.end[0] - brick.begin[0];
+      detail::cellRow row;
+
+      for (std::size_t k = brick.begin[2]; k < brick.end[2]; ++k)
+      {
+        for (std::size_t j = brick.begin[1]; j < brick.end[1]; ++j)
+        {
+          for (std::size_t c = 0; c < 8; ++c)
+          {
+            const auto* p =
+              &zone.points[zone.index(brick.begin[0] + (c & 1),
+                                      j + ((c >> 1) & 1),
+                                      k + (c >> 2))];
+            for (std::size_t m = 0; m < n; ++m)
+            {
+              row.x[c][m] = p[m].x;
+              row.y[c][m] = p[m].y;
+              row.z[c][m] = p[m].z;
+            }
+          }
+
+          const std::size_t cell = brick.begin[0] + ni * (j + nj * k);
+          float* volume = &result.cells[0][cell];
+          detail::quality_kernel(row,
+                                 n,
+                                 volume,
+                                 &result.cells[1][cell],
+                                 &result.cells[2][cell],
+                                 &result.cells[3][cell]);
+
+          for (std::size_t m = 0; m < n; ++m)
+          {
+            brickVolume[iBrick] += volume[m];
+          }
+        }
+      }
+    });
+
+  double totalVolume = 0.0;
+  for (const auto v : brickVolume)
+  {
+    totalVolume += v;
+  }
+
+  auto& volume = result.cells[std::size_t(qualityMetric::volume)];
+  auto& jacobian = result.cells[std::size_t(qualityMetric::jacobian)];
+  if (totalVolume < 0.0)
+  {
+    parallel_for(0,
+                 nCells,
+                 1 << 16,
+                 [&](const std::size_t i)
+                 {
+                   volume[i] = -volume[i];
+                   jacobian[i] = -jacobian[i];
+                 });
+  }
+
+  for (std::size_t m = 0; m < n_quality_metrics; ++m)
+  {
+    const auto [min, max] =
+      std::minmax_element(result.cells[m].begin(), result.cells[m].end());
+    result.min[m] = *min;
+    result.max[m] = *max;
+  }
+  result.nNegative = std::size_t(
+    std::count_if(jacobian.begin(), jacobian.end(), [](const float v)
+                  { return v < 0.0f; }));
+
+  std::size_t bytes = 0;
+  for (const auto& cells : result.cells)
+  {
+    bytes += memory::bytes(cells);
+  }
+  result.usage.reset(memory::category::caches, bytes);
+
+  return result;
+}
+
+/// zones with quality fields and the distribution of every metric
+struct gridQualityResult
+{
+  std::shared_ptr<const std::vector<structuredZone>> zones;
+  std::array<qualityHistogram, n_quality_metrics> histograms;
+  std::size_t nCells = 0;
+  std::size_t nNegative = 0;
+  /// cells computed by this call, zones with a cached result are skipped
+  std::size_t nComputed = 0;
+  double seconds = 0.0;
+
+  double cells_per_second() const
+  {
+    return seconds > 0.0 ? nComputed / seconds : 0.0;
+  }
+};
+
+/// zones with the quality metrics as vertex fields
+///
+/// Zones that already carry their quality reuse it, the others are computed
+/// in parallel over the zones and their bricks. The zones share the points
+/// and fields of the input, see copy_zone, so only the quality fields take
+/// new memory. The points are unchanged, so the zones can replace the zones
+/// of data without a new upload.
+inline gridQualityResult
+compute_grid_quality(const std::vector<structuredZone>& zones)
+{
+  const trace::scope traceScope{ "grid quality", "quality" };
+  const auto start = std::chrono::steady_clock::now();
+
+  gridQualityResult result;
+  auto copies = std::make_shared<std::vector<structuredZone>>();
+  copies->reserve(zones.size());
+  for (const auto& zone : zones)
+  {
+    copies->emplace_back(copy_zone(zone));
+  }
+
+  std::vector<std::size_t> computed(zones.size(), 0);
+  parallel_for(
+    0,
+    copies->size(),
+    1,
+    [&](const std::size_t z)
+    {
+      auto& copy = (*copies)[z];
+      if (copy.quality)
+      {
+        return;
+      }
+
+      auto quality =
+        std::make_shared<zoneQuality>(compute_zone_quality(copy));
+      computed[z] = copy.n_cells();
+
+      for (std::size_t m = 0; m < n_quality_metrics; ++m)
+      {
+        copy.fields.emplace_back(
+          detail::vertex_field(copy, quality->cells[m], qualityMetric(m)));
+      }
+      copy.quality = std::move(quality);
+      copy.account_memory();
+    });
+  for (const auto n : computed)
+  {
+    result.nComputed += n;
+  }
+
+  const auto stop = std::chrono::steady_clock::now();
+  result.seconds = std::chrono::duration<double>(stop - start).count();
+
+  // histograms over the common range of all zones
+  for (std::size_t m = 0; m < n_quality_metrics; ++m)
+  {
+    auto& histogram = result.histograms[m];
+    histogram.min = std::numeric_limits<float>::max();
+    histogram.max = std::numeric_limits<float>::lowest();
+    for (const auto& zone : *copies)
+    {
+      if (zone.n_cells() > 0)
+      {
+        histogram.min = std::min(histogram.min, zone.quality->min[m]);
+        histogram.max = std::max(histogram.max, zone.quality->max[m]);
+      }
+    }
+  }
+
+  std::mutex mutex;
+  for (const auto& zone : *copies)
+  {
+    const auto& quality = *zone.quality;
+    result.nCells += zone.n_cells();
+    result.nNegative += quality.nNegative;
+
+    constexpr std::size_t grain = 1 << 16;
+    parallel_for(
+      0,
+      (zone.n_cells() + grain - 1) / grain,
+      1,
+      [&](const std::size_t chunk)
+      {
+        const std::size_t begin = chunk * grain;
+        const std::size_t end = std::min(begin + grain, zone.n_cells());
+
+        std::array<qualityHistogram, n_quality_metrics> local{};
+        for (std::size_t m = 0; m < n_quality_metrics; ++m)
+        {
+          const auto& h = result.histograms[m];
+          const float scale =
+            h.max > h.min ? qualityHistogram::n_bins / (h.max - h.min) : 0.0f;
+          for (std::size_t i = begin; i < end; ++i)
+          {
+            const float v = quality.cells[m][i];
+            const auto bin = std::min(std::size_t((v - h.min) * scale),
+                                      qualityHistogram::n_bins - 1);
+            ++local[m].counts[bin];
+            local[m].mean += v;
+          }
+        }
+
+        std::lock_guard lock{ mutex };
+        for (std::size_t m = 0; m < n_quality_metrics; ++m)
+        {
+          auto& h = result.histograms[m];
+          for (std::size_t b = 0; b < qualityHistogram::n_bins; ++b)
+          {
+            h.counts[b] += local[m].counts[b];
+          }
+          h.mean += local[m].mean;
+        }
+      });
+  }
+
+  for (auto& histogram : result.histograms)
+  {
+    if (result.nCells > 0)
+    {
+      histogram.mean /= double(result.nCells);
+    }
+    else
+    {
+      histogram.min = histogram.max = 0.0f;
+    }
+  }
+
+  result.zones = std::move(copies);
+  return result;
+}
+
+/// grid quality computed on request on the thread pool
+struct gridQualityTool
+{
+  /// call once per frame on the GL thread with the zones of data, returns
+  /// zones with quality fields to replace them once they are ready
+  std::shared_ptr<const std::vector<structuredZone>> update(
+    std::shared_ptr<const std::vector<structuredZone>> zones)
+  {
+    if (zones != _zones)
+    {
+      _zones = std::move(zones);
+      // a new file, unless these are the zones handed out below
+      if (!_result || _result->zones != _zones)
+      {
+        _result.reset();
+      }
+    }
+
+    if (_computing.valid() && _computing.wait_for(std::chrono::seconds(0)) ==
+                                std::future_status::ready)
+    {
+      auto result = _computing.get();
+      if (_computingZones == _zones)
+      {
+        _result = std::move(result);
+        _computingZones.reset();
+        return _result->zones;
+      }
+      _computingZones.reset();
+    }
+
+    return nullptr;
+  }
+
+  /// start computing the metrics of the current zones
+  void compute()
+  {
+    if (!_zones || busy())
+    {
+      return;
+    }
+
+    _computingZones = _zones;
+    _computing = default_pool().submit(
+      [zones = _zones] { return compute_grid_quality(*zones); });
+  }
+
+  /// metrics of the current zones, if computed
+  const gridQualityResult* result() const
+  {
+    return _result ? &(*_result) : nullptr;
+  }
+
+  bool busy() const noexcept { return _computing.valid(); }
+
+private:
+  std::shared_ptr<const std::vector<structuredZone>> _zones;
+  std::shared_ptr<const std::vector<structuredZone>> _computingZones;
+  std::future<gridQualityResult> _computing;
+  std::optional<gridQualityResult> _result;
+};
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,534 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "colormap.hpp"
+#include "marchingTetrahedra.hpp"
+#include "meshBuffer.hpp"
+#include "parallel.hpp"
+#include "shader.hpp"
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <glm/glm.hpp>
+#include <limits>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// parameters of an iso-surface extraction
+struct isoSurfaceSettings
+{
+  std::string field;
+  float value = 0.0f;
+};
+
+namespace detail
+{
+
+/// grid edge, identified by its sorted point indices
+struct edgeKey
+{
+  uint64_t a;
+  uint64_t b;
+
+  bool operator==(const edgeKey& other) const
+  {
+    return a == other.a && b == other.b;
+  }
+};
+
+struct edgeKeyHash
+{
+  std::size_t operator()(const edgeKey& key) const noexcept
+  {
+    return key.a * 0x9E3779B97F4A7C15ull ^ (key.b + (key.a << 6));
+  }
+};
+
+/// iso-surface inside a single brick, vertices are welded within the brick
+struct isoPart
+{
+  std::vector<glm::vec3> positions;
+  std::vector<edgeKey> keys;
+  std::vector<uint8_t> boundary; ///< vertex may be shared with other bricks
+  std::vector<uint32_t> indices; ///< brick local vertex indices
+
+  std::size_t zone = 0;
+  std::size_t indexOffset = 0;
+  std::vector<uint32_t> remap; ///< brick local to global vertex index
+  std::vector<uint8_t> owner;  ///< this part writes the global vertex
+};
+
+} // namespace detail
+
+/// welded iso-surface split into bricks, ready to be written into a
+/// meshBuffer by write_iso_surface
+struct isoSurfaceResult
+{
+  isoSurfaceSettings settings;
+  std::vector<detail::isoPart> parts;
+  glm::vec3 color{ 1.0f, 1.0f, 1.0f };
+
+  std::size_t nVertices = 0;
+  std::size_t nIndices = 0;
+  std::size_t nCells = 0;
+  std::size_t nBricks = 0;
+  std::size_t nBricksVisited = 0;
+  double seconds = 0.0;
+
+  /// all cells of the zones divided by the extraction time
+  double cells_per_second() const
+  {
+    return seconds > 0.0 ? nCells / seconds : 0.0;
+  }
+};
+
+/// extract the iso-surface settings.value of settings.field
+///
+/// Bricks whose value range does not contain the iso value are skipped. The
+/// remaining bricks are processed in parallel by marching tetrahedra on the
+/// six tetrahedra per cell, sharing the kernel of the cut plane. Vertices on
+/// the same grid edge are welded, within a brick by a hash map and across
+/// brick boundaries in a final pass over the boundary vertices.
+inline isoSurfaceResult
+extract_iso_surface(const std::vector<structuredZone>& zones,
+                    const isoSurfaceSettings& settings)
+{
+  const trace::scope traceScope{ "extract iso-surface", "extract" };
+  const auto start = std::chrono::steady_clock::now();
+
+  isoSurfaceResult result;
+  result.settings = settings;
+
+  struct brickRef
+  {
+    std::size_t zone;
+    std::size_t brick;
+  };
+
+  float min = std::numeric_limits<float>::max();
+  float max = std::numeric_limits<float>::lowest();
+
+  std::vector<brickRef> touched;
+  for (std::size_t z = 0; z < zones.size(); ++z)
+  {
+    result.nCells += zones[z].n_cells();
+    result.nBricks += zones[z].bricks.size();
+
+    const auto* field = zones[z].field(settings.field);
+    if (!field)
+    {
+      continue;
+    }
+
+    min = std::min(min, field->min);
+    max = std::max(max, field->max);
+
+    for (std::size_t b = 0; b < zones[z].bricks.size(); ++b)
+    {
+      if (field->brickMin[b] <= settings.value &&
+          settings.value <= field->brickMax[b])
+      {
+        touched.push_back({ z, b });
+      }
+    }
+  }
+  result.nBricksVisited = touched.size();
+  result.color = colormap(settings.value, min, max);
+
+  result.parts.resize(touched.size());
+
+  // field values of the touched zones, compressed fields are decoded here
+  std::vector<std::optional<fieldValues>> zoneValues(zones.size());
+  for (const auto& t : touched)
+  {
+    if (!zoneValues[t.zone])
+    {
+      zoneValues[t.zone].emplace(*zones[t.zone].field(settings.field));
+    }
+  }
+
+  parallel_for(
+    0,
+    touched.size(),
+    1,
+    [&](const std::size_t iTouched)
+    {
+      const auto& zone = zones[touched[iTouched].zone];
+      const auto& brick = zone.bricks[touched[iTouched].brick];
+      const auto& values = *zoneValues[touched[iTouched].zone];
+
+      auto& part = result.parts[iTouched];
+      part.zone = touched[iTouched].zone;
+
+      std::unordered_map<detail::edgeKey, uint32_t, detail::edgeKeyHash>
+        welded;
+
+      std::array<std::size_t, 8> points;
+      std::array<float, 8> d;
+      std::array<bool, 8> onBoundary;
+      std::array<std::size_t, 4> tetPoints;
+      std::array<bool, 4> tetOnBoundary;
+      std::array<float, 4> tetDist;
+
+      const auto vertex = [&](const tetEdge& e) -> uint32_t
+      {
+        const auto pa = tetPoints[e[0]];
+        const auto pb = tetPoints[e[1]];
+        const detail::edgeKey key{ std::min(pa, pb), std::max(pa, pb) };
+
+        const auto [it, inserted] = welded.try_emplace(
+          key, static_cast<uint32_t>(part.positions.size()));
+        if (inserted)
+        {
+          const float t = edge_weight(tetDist[e[0]], tetDist[e[1]]);
+          part.positions.push_back(
+            zone.points[pa] + t * (zone.points[pb] - zone.points[pa]));
+          part.keys.push_back(key);
+          part.boundary.push_back(tetOnBoundary[e[0]] &&
+                                  tetOnBoundary[e[1]]);
+        }
+        return it->second;
+      };
+
+      const auto emit =
+        [&](const tetEdge& a, const tetEdge& b, const tetEdge& c)
+      {
+        part.indices.push_back(vertex(a));
+        part.indices.push_back(vertex(b));
+        part.indices.push_back(vertex(c));
+      };
+
+      for (std::size_t k = brick.begin[2]; k < brick.end[2]; ++k)
+      {
+        for (std::size_t j = brick.begin[1]; j < brick.end[1]; ++j)
+        {
+          for (std::size_t i = brick.begin[0]; i < brick.end[0]; ++i)
+          {
+            bool hasInside = false;
+            bool hasOutside = false;
+            for (std::size_t c = 0; c < 8; ++c)
+            {
+              const std::array<std::size_t, 3> ijk{ i + hex_corners[c][0],
+                                                    j + hex_corners[c][1],
+                                                    k + hex_corners[c][2] };
+              points[c] = zone.index(ijk[0], ijk[1], ijk[2]);
+              d[c] = values[points[c]] - settings.value;
+              (d[c] >= 0.0f ? hasInside : hasOutside) = true;
+
+              onBoundary[c] = false;
+              for (std::size_t dir = 0; dir < 3; ++dir)
+              {
+                onBoundary[c] |= ijk[dir] == brick.begin[dir] ||
+                                 ijk[dir] == brick.end[dir];
+              }
+            }
+
+            if (!hasInside || !hasOutside)
+            {
+              continue;
+            }
+
+            for (const auto& tet : hex_tets)
+            {
+              for (std::size_t q = 0; q < 4; ++q)
+              {
+                tetPoints[q] = points[tet[q]];
+                tetOnBoundary[q] = onBoundary[tet[q]];
+                tetDist[q] = d[tet[q]];
+              }
+              march_tet(tetDist, emit);
+            }
+          }
+        }
+      }
+    });
+
+  // weld across bricks, only vertices on brick boundaries can be shared and
+  // zones do not share point indices
+  std::unordered_map<detail::edgeKey, uint32_t, detail::edgeKeyHash> shared;
+  std::size_t currentZone = std::numeric_limits<std::size_t>::max();
+  for (auto& part : result.parts)
+  {
+    if (part.zone != currentZone)
+    {
+      shared.clear();
+      currentZone = part.zone;
+    }
+
+    const std::size_t nLocal = part.positions.size();
+    part.remap.resize(nLocal);
+    part.owner.resize(nLocal);
+
+    for (std::size_t v = 0; v < nLocal; ++v)
+    {
+      auto global = static_cast<uint32_t>(result.nVertices);
+      bool owner = true;
+
+      if (part.boundary[v])
+      {
+        const auto [it, inserted] = shared.try_emplace(part.keys[v], global);
+        global = it->second;
+        owner = inserted;
+      }
+
+      part.remap[v] = global;
+      part.owner[v] = owner;
+      if (owner)
+      {
+        ++result.nVertices;
+      }
+    }
+
+    part.indexOffset = result.nIndices;
+    result.nIndices += part.indices.size();
+  }
+
+  result.seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+
+  return result;
+}
+
+/// write an extracted iso-surface into mapped mesh storage in parallel
+inline void
+write_iso_surface(const isoSurfaceResult& result,
+                  const meshBuffer::mapping& target)
+{
+  const trace::scope traceScope{ "write iso-surface", "upload" };
+  const auto& color = result.color;
+
+  parallel_for(0,
+               result.parts.size(),
+               1,
+               [&](const std::size_t iPart)
+               {
+                 const auto& part = result.parts[iPart];
+
+                 for (std::size_t v = 0; v < part.positions.size(); ++v)
+                 {
+                   if (!part.owner[v])
+                   {
+                     continue;
+                   }
+
+                   float* out = target.vertices +
+                                part.remap[v] * meshBuffer::floats_per_vertex;
+                   const auto& p = part.positions[v];
+                   out[0] = p.x;
+                   out[1] = p.y;
+                   out[2] = p.z;
+                   out[3] = color.x;
+                   out[4] = color.y;
+                   out[5] = color.z;
+                 }
+
+                 uint32_t* out = target.indices + part.indexOffset;
+                 for (const auto index : part.indices)
+                 {
+                   *out++ = part.remap[index];
+                 }
+               });
+}
+
+/// interactive iso-surface with a cache of recent (field, value) meshes
+///
+/// Extraction and the write into the mapped GPU buffer run on the thread
+/// pool, the GL thread only allocates, maps and unmaps the buffers.
+struct isoSurfaceTool
+{
+  /// number of cached iso-surfaces
+  static constexpr std::size_t cache_size = 8;
+
+  isoSurfaceSettings settings;
+  bool enabled = false;
+
+  isoSurfaceTool() = default;
+
+  /// destructor, the pool may still write into a mapped buffer
+  ~isoSurfaceTool()
+  {
+    if (_writing)
+    {
+      _writing->done.wait();
+    }
+  }
+
+  isoSurfaceTool(const isoSurfaceTool& other) = delete;
+  isoSurfaceTool& operator=(const isoSurfaceTool& other) = delete;
+
+  /// extraction statistics of a cached iso-surface
+  struct stats
+  {
+    std::size_t nTriangles = 0;
+    std::size_t nVertices = 0;
+    std::size_t nBricksVisited = 0;
+    std::size_t nBricks = 0;
+    double seconds = 0.0;
+    double cellsPerSecond = 0.0;
+  };
+
+  /// call once per frame on the GL thread
+  void update(std::shared_ptr<const std::vector<structuredZone>> zones)
+  {
+    if (zones != _zones)
+    {
+      _zones = std::move(zones);
+      _cache.clear();
+    }
+
+    // extraction finished, map a new buffer and write it on the pool
+    if (_extracting.valid() && _extracting.wait_for(std::chrono::seconds(
+                                 0)) == std::future_status::ready)
+    {
+      auto result =
+        std::make_shared<const isoSurfaceResult>(_extracting.get());
+
+      if (_extractingZones == _zones)
+      {
+        meshBuffer mesh{ result->nVertices,
+                         result->nIndices,
+                         memory::category::caches };
+        const auto target = mesh.map();
+
+        _writing.emplace(
+          writeJob{ result,
+                    _zones,
+                    std::move(mesh),
+                    default_pool().submit(
+                      [result, target]
+                      {
+                        if (target.indices)
+                        {
+                          write_iso_surface(*result, target);
+                        }
+                      }) });
+      }
+      _extractingZones.reset();
+    }
+
+    // write finished, unmap and move into the cache
+    if (_writing && _writing->done.wait_for(std::chrono::seconds(0)) ==
+                      std::future_status::ready)
+    {
+      _writing->done.get();
+      _writing->mesh.unmap();
+
+      const auto& result = *_writing->result;
+      if (_writing->zones == _zones)
+      {
+        _cache.push_front(
+          entry{ result.settings,
+                 std::move(_writing->mesh),
+                 { result.nIndices / 3,
+                   result.nVertices,
+                   result.nBricksVisited,
+                   result.nBricks,
+                   result.seconds,
+                   result.cells_per_second() } });
+        if (_cache.size() > cache_size)
+        {
+          _cache.pop_back();
+        }
+      }
+
+      _writing.reset();
+    }
+
+    if (!enabled || !_zones || settings.field.empty() || _extracting.valid() ||
+        _writing)
+    {
+      return;
+    }
+
+    if (const auto it = find(settings); it != _cache.end())
+    {
+      // most recently used first
+      _cache.splice(_cache.begin(), _cache, it);
+      return;
+    }
+
+    _extractingZones = _zones;
+    _extracting = default_pool().submit(
+      [zones = _zones, request = settings]
+      { return extract_iso_surface(*zones, request); });
+  }
+
+  /// draws the requested iso-surface, or the most recent one of the same
+  /// field while the requested one is computed
+  void render(const shader& shader)
+  {
+    if (!enabled || _cache.empty())
+    {
+      return;
+    }
+
+    if (_cache.front().settings.field == settings.field)
+    {
+      _cache.front().mesh.draw(shader);
+    }
+  }
+
+  /// statistics of the shown iso-surface
+  std::optional<stats> last_stats() const
+  {
+    if (_cache.empty())
+    {
+      return std::nullopt;
+    }
+    return _cache.front().statistics;
+  }
+
+  std::size_t cached() const noexcept { return _cache.size(); }
+
+  bool busy() const noexcept { return _extracting.valid() || _writing; }
+
+private:
+  struct entry
+  {
+    isoSurfaceSettings settings;
+    meshBuffer mesh;
+    stats statistics;
+  };
+
+  struct writeJob
+  {
+    std::shared_ptr<const isoSurfaceResult> result;
+    std::shared_ptr<const std::vector<structuredZone>> zones;
+    meshBuffer mesh;
+    std::future<void> done;
+  };
+
+  std::shared_ptr<const std::vector<structuredZone>> _zones;
+  std::shared_ptr<const std::vector<structuredZone>> _extractingZones;
+  std::future<isoSurfaceResult> _extracting;
+  std::optional<writeJob> _writing;
+  std::list<entry> _cache;
+
+  std::list<entry>::iterator find(const isoSurfaceSettings& s)
+  {
+    return std::find_if(_cache.begin(),
+                        _cache.end(),
+                        [&](const entry& e)
+                        {
+                          return e.settings.field == s.field &&
+                                 e.settings.value == s.value;
+                        });
+  }
+};
+
+} // namespace cgns_tools::gui
@@ -3,6 +3,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
 namespace cgns_tools::gui
@@ -10,14 +14,81 @@ namespace cgns_tools::gui
 
 static constexpr auto default_logger_name = "cgns-tools-gui-logger";
 
+namespace detail
+{
+
+/// asynchronous logger together with the thread writing its messages
+struct asyncLogging
+{
+  std::shared_ptr<spdlog::details::thread_pool> threads;
+  std::shared_ptr<spdlog::logger> logger;
+};
+
+/// logger used by the log functions
+///
+/// Its control block owns the whole asyncLogging, so a caller still logging
+/// keeps the logger and its thread alive after shutdown_logging.
+inline std::atomic<std::shared_ptr<spdlog::logger>> active_logger{};
+
+} // namespace detail
+
+/// create the default logger with an asynchronous sink
+///
+/// Messages are formatted by the calling thread and written by a background
+/// thread. If the queue is full the oldest message is dropped, logging never
+/// blocks the caller.
+inline void
+init_logging()
+{
+  if (detail::active_logger.load(std::memory_order_acquire))
+  {
+    return;
+  }
+
+  auto logging = std::make_shared<detail::asyncLogging>();
+  logging->threads = std::make_shared<spdlog::details::thread_pool>(8192, 1);
+  logging->logger = std::make_shared<spdlog::async_logger>(
+    default_logger_name,
+    std::make_shared<spdlog::sinks::stderr_color_sink_mt>(),
+    logging->threads,
+    spdlog::async_overflow_policy::overrun_oldest);
+  spdlog::register_logger(logging->logger);
+
+  auto* logger = logging->logger.get();
+  detail::active_logger.store({ std::move(logging), logger },
+                              std::memory_order_release);
+}
+
+/// stop logging, pending messages are written
+///
+/// Pool tasks and continuations may still be logging. Each holds the logger
+/// while it logs, the logger and its thread are destroyed once the last one
+/// returns, after writing the queued messages.
+inline void
+shutdown_logging()
+{
+  detail::active_logger.store(nullptr, std::memory_order_release);
+  spdlog::shutdown();
+}
+
 template<typename... Args>
 void
 log_error(spdlog::format_string_t<Args...> fmt, Args&&... args)
 {
-  if (spdlog::get(default_logger_name) != nullptr)
+  if (auto logger = detail::active_logger.load(std::memory_order_acquire))
+  {
+    logger->error(fmt, std::forward<Args>(args)...);
+  }
+}
+
+template<typename... Args>
+void
+log_info(spdlog::format_string_t<Args...> fmt, Args&&... args)
+{
+  if (auto logger = detail::active_logger.load(std::memory_order_acquire))
   {
-    spdlog::get(default_logger_name)->error(std::forward<Args>(args)...);
+    logger->info(fmt, std::forward<Args>(args)...);
   }
 }
 
-} // namespace cgns_tools::gui
\ No newline at end of file
+} // namespace cgns_tools::gui
@@ -0,0 +1,96 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace cgns_tools::gui
+{
+
+/// corner offsets (i, j, k) of a hexahedral cell, bit 0 -> i, 1 -> j, 2 -> k
+inline constexpr std::array<std::array<std::size_t, 3>, 8> hex_corners{ {
+  { 0, 0, 0 },
+  { 1, 0, 0 },
+  { 0, 1, 0 },
+  { 1, 1, 0 },
+  { 0, 0, 1 },
+  { 1, 0, 1 },
+  { 0, 1, 1 },
+  { 1, 1, 1 },
+} };
+
+/// decomposition of a hexahedral cell into six tetrahedra sharing the diagonal
+/// from corner 0 to corner 7, this is consistent across neighbouring cells
+inline constexpr std::array<std::array<int, 4>, 6> hex_tets{ {
+  { 0, 1, 3, 7 },
+  { 0, 3, 2, 7 },
+  { 0, 2, 6, 7 },
+  { 0, 6, 4, 7 },
+  { 0, 4, 5, 7 },
+  { 0, 5, 1, 7 },
+} };
+
+/// edge between two vertices of a tetrahedron, first vertex is inside
+using tetEdge = std::array<int, 2>;
+
+/// marching tetrahedra on a single tetrahedron
+///
+/// Vertices with dist >= 0 are inside. Calls emit(e0, e1, e2) for each of
+/// the up to two triangles of the surface dist = 0, the triangle vertices lie
+/// on the given tetrahedron edges.
+template<typename Emit>
+void
+march_tet(const std::array<float, 4>& dist, Emit&& emit)
+{
+  std::array<int, 4> inside;
+  std::array<int, 4> outside;
+  int nInside = 0;
+  int nOutside = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    if (dist[i] >= 0.0f)
+    {
+      inside[nInside++] = i;
+    }
+    else
+    {
+      outside[nOutside++] = i;
+    }
+  }
+
+  if (nInside == 1)
+  {
+    const int a = inside[0];
+    emit(tetEdge{ a, outside[0] },
+         tetEdge{ a, outside[1] },
+         tetEdge{ a, outside[2] });
+  }
+  else if (nInside == 3)
+  {
+    const int a = outside[0];
+    emit(tetEdge{ inside[0], a },
+         tetEdge{ inside[1], a },
+         tetEdge{ inside[2], a });
+  }
+  else if (nInside == 2)
+  {
+    // the four edge points in cyclic order form the quad ac, ad, bd, bc
+    const int a = inside[0];
+    const int b = inside[1];
+    const int c = outside[0];
+    const int d = outside[1];
+    emit(tetEdge{ a, c }, tetEdge{ a, d }, tetEdge{ b, d });
+    emit(tetEdge{ a, c }, tetEdge{ b, d }, tetEdge{ b, c });
+  }
+}
+
+/// parameter of the surface crossing on an edge with distances da and db
+inline float
+edge_weight(const float da, const float db)
+{
+  return da / (da - db);
+}
+
+} // namespace cgns_tools::gui
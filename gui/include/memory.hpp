@@ -0,0 +1,201 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// byte counters per allocation class with high-water marks
+///
+/// Owners of large allocations hold a memory::allocation, which updates the
+/// counter of its category with a single atomic add when the size changes.
+namespace cgns_tools::gui::memory
+{
+
+enum class category : std::size_t
+{
+  tree,         ///< cgns tree as returned by readBaseInformation
+  zones,        ///< zones converted for rendering
+  staging,      ///< CPU copies of uploaded vertex data
+  gl_buffers,   ///< vertex, index and pixel buffers
+  framebuffers, ///< framebuffer attachments
+  caches,       ///< cached extraction results
+  count
+};
+
+inline constexpr std::array<const char*, std::size_t(category::count)>
+  category_names{ "CGNS tree",   "Zones",        "Staging vectors",
+                  "GL buffers",  "Framebuffers", "Caches" };
+
+struct counter
+{
+  std::atomic<int64_t> current{ 0 };
+  std::atomic<int64_t> peak{ 0 };
+
+  void add(const int64_t bytes)
+  {
+    const auto now =
+      current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    auto high = peak.load(std::memory_order_relaxed);
+    while (now > high &&
+           !peak.compare_exchange_weak(high, now, std::memory_order_relaxed))
+    {
+    }
+  }
+};
+
+inline counter&
+get(const category c)
+{
+  static std::array<counter, std::size_t(category::count)> counters;
+  return counters[std::size_t(c)];
+}
+
+/// bytes accounted to a category for the lifetime of the object
+struct allocation
+{
+  allocation() = default;
+
+  allocation(const category c, const std::size_t bytes)
+    : _category{ c }
+    , _bytes{ 0 }
+  {
+    reset(bytes);
+  }
+
+  ~allocation() { reset(0); }
+
+  allocation(const allocation& other) = delete;
+  allocation& operator=(const allocation& other) = delete;
+
+  allocation(allocation&& other) noexcept
+    : _category{ other._category }
+    , _bytes{ std::exchange(other._bytes, 0) }
+  {
+  }
+
+  allocation& operator=(allocation&& other) noexcept
+  {
+    std::swap(_category, other._category);
+    std::swap(_bytes, other._bytes);
+    return *this;
+  }
+
+  /// change the accounted size
+  void reset(const std::size_t bytes)
+  {
+    if (bytes != _bytes)
+    {
+      get(_category).add(int64_t(bytes) - int64_t(_bytes));
+      _bytes = bytes;
+    }
+  }
+
+  /// change the accounted category and size
+  void reset(const category c, const std::size_t bytes)
+  {
+    reset(0);
+    _category = c;
+    reset(bytes);
+  }
+
+  std::size_t bytes() const noexcept { return _bytes; }
+
+private:
+  category _category = category::staging;
+  std::size_t _bytes = 0;
+};
+
+/// bytes of a vector including unused capacity
+template<typename T>
+std::size_t
+bytes(const std::vector<T>& v)
+{
+  return v.capacity() * sizeof(T);
+}
+
+/// memory of one zone of the loaded file
+struct zoneUsage
+{
+  std::string name;
+  std::size_t tree = 0;
+  std::size_t zone = 0;
+  std::size_t gpu = 0;
+};
+
+namespace detail
+{
+
+struct zoneRegistry
+{
+  std::mutex mutex;
+  std::vector<zoneUsage> zones;
+};
+
+inline zoneRegistry&
+get_zone_registry()
+{
+  static zoneRegistry instance;
+  return instance;
+}
+
+} // namespace detail
+
+/// replace the per zone breakdown, e.g. after loading a file
+inline void
+set_zones(std::vector<zoneUsage> zones)
+{
+  auto& r = detail::get_zone_registry();
+  std::lock_guard lock{ r.mutex };
+  r.zones = std::move(zones);
+}
+
+/// copy of the per zone breakdown
+inline std::vector<zoneUsage>
+zones()
+{
+  auto& r = detail::get_zone_registry();
+  std::lock_guard lock{ r.mutex };
+  return r.zones;
+}
+
+/// print current and peak bytes per category, and the per zone breakdown
+inline void
+print(std::FILE* file)
+{
+  constexpr double mb = 1.0 / (1024.0 * 1024.0);
+
+  int64_t total = 0;
+  for (std::size_t c = 0; c < std::size_t(category::count); ++c)
+  {
+    const auto& counter = get(category(c));
+    const auto current = counter.current.load(std::memory_order_relaxed);
+    total += current;
+    std::fprintf(file,
+                 "memory %s: %.1f MB, peak %.1f MB\n",
+                 category_names[c],
+                 mb * current,
+                 mb * counter.peak.load(std::memory_order_relaxed));
+  }
+  std::fprintf(file, "memory total: %.1f MB\n", mb * total);
+
+  for (const auto& zone : zones())
+  {
+    std::fprintf(file,
+                 "memory zone %s: tree %.1f MB, zone %.1f MB, gpu %.1f MB\n",
+                 zone.name.c_str(),
+                 mb * zone.tree,
+                 mb * zone.zone,
+                 mb * zone.gpu);
+  }
+}
+
+} // namespace cgns_tools::gui::memory
@@ -0,0 +1,224 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "helpers.hpp"
+#include "memory.hpp"
+#include "shader.hpp"
+#include <cstdint>
+#include <glad/glad.h>
+#include <utility>
+
+namespace cgns_tools::gui
+{
+
+/// indexed triangles with per vertex color, interleaved as x, y, z, r, g, b
+///
+/// The storage is allocated up front and filled through map(), so the
+/// vertices can be written directly into the buffer by worker threads.
+struct meshBuffer
+{
+  static constexpr std::size_t floats_per_vertex = 6;
+
+  /// pointers into the mapped buffers
+  struct mapping
+  {
+    float* vertices;
+    uint32_t* indices;
+  };
+
+  /// constructor, the buffer memory is accounted to category
+  meshBuffer(const std::size_t nVertices,
+             const std::size_t nIndices,
+             const memory::category category = memory::category::gl_buffers)
+    : _nVertices{ nVertices }
+    , _nIndices{ nIndices }
+    , _vbo{}
+    , _ibo{}
+    , _vao{}
+    , _memory{ category,
+               nVertices * floats_per_vertex * sizeof(float) +
+                 nIndices * sizeof(uint32_t) }
+  {
+    create_buffers();
+  }
+
+  /// destructor
+  ~meshBuffer() { delete_buffers(); }
+
+  /// copy constructor
+  meshBuffer(const meshBuffer& other) = delete;
+
+  /// move constructor
+  meshBuffer(meshBuffer&& other) noexcept
+    : _nVertices{ other._nVertices }
+    , _nIndices{ other._nIndices }
+    , _vbo{ other._vbo }
+    , _ibo{ other._ibo }
+    , _vao{ other._vao }
+    , _memory{ std::move(other._memory) }
+  {
+    other._vbo = 0;
+    other._ibo = 0;
+    other._vao = 0;
+  }
+
+  /// copy assignment
+  meshBuffer& operator=(const meshBuffer& other) = delete;
+
+  /// move assignment
+  meshBuffer& operator=(meshBuffer&& other) noexcept
+  {
+    std::swap(_nVertices, other._nVertices);
+    std::swap(_nIndices, other._nIndices);
+    std::swap(_vbo, other._vbo);
+    std::swap(_ibo, other._ibo);
+    std::swap(_vao, other._vao);
+    std::swap(_memory, other._memory);
+    return *this;
+  }
+
+  std::size_t n_vertices() const noexcept { return _nVertices; }
+
+  std::size_t n_triangles() const noexcept { return _nIndices / 3; }
+
+  std::size_t size_bytes() const noexcept
+  {
+    return _nVertices * floats_per_vertex * sizeof(float) +
+           _nIndices * sizeof(uint32_t);
+  }
+
+  /// map vertex and index storage for writing, the buffer must not be drawn
+  /// until unmap() was called
+  mapping map()
+  {
+    if (_nIndices == 0)
+    {
+      return { nullptr, nullptr };
+    }
+
+    bind();
+    opengl_fn<glBindBuffer>(GL_ARRAY_BUFFER, _vbo);
+
+    constexpr GLbitfield access =
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+    auto* vertices = static_cast<float*>(opengl_fn<glMapBufferRange>(
+      GL_ARRAY_BUFFER,
+      0,
+      _nVertices * floats_per_vertex * sizeof(float),
+      access));
+    auto* indices = static_cast<uint32_t*>(opengl_fn<glMapBufferRange>(
+      GL_ELEMENT_ARRAY_BUFFER, 0, _nIndices * sizeof(uint32_t), access));
+
+    unbind();
+
+    return { vertices, indices };
+  }
+
+  void unmap()
+  {
+    if (_nIndices == 0)
+    {
+      return;
+    }
+
+    bind();
+    opengl_fn<glBindBuffer>(GL_ARRAY_BUFFER, _vbo);
+    opengl_fn<glUnmapBuffer>(GL_ARRAY_BUFFER);
+    opengl_fn<glUnmapBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+    unbind();
+  }
+
+  void draw(const shader& shader)
+  {
+    if (_nIndices == 0)
+    {
+      return;
+    }
+
+    shader.use();
+
+    bind();
+
+    opengl_fn<glDrawElements>(
+      GL_TRIANGLES, _nIndices, GL_UNSIGNED_INT, (void*)0);
+
+    unbind();
+  }
+
+private:
+  std::size_t _nVertices;
+  std::size_t _nIndices;
+
+  GLuint _vbo;
+  GLuint _ibo;
+  GLuint _vao;
+
+  memory::allocation _memory;
+
+  void bind() { opengl_fn<glBindVertexArray>(_vao); }
+
+  void unbind() { opengl_fn<glBindVertexArray>(0); }
+
+  void create_buffers()
+  {
+    opengl_fn<glGenVertexArrays>(1, &_vao);
+    opengl_fn<glBindVertexArray>(_vao);
+
+    opengl_fn<glGenBuffers>(1, &_vbo);
+    opengl_fn<glBindBuffer>(GL_ARRAY_BUFFER, _vbo);
+    opengl_fn<glBufferData>(GL_ARRAY_BUFFER,
+                            _nVertices * floats_per_vertex * sizeof(float),
+                            nullptr,
+                            GL_STATIC_DRAW);
+
+    opengl_fn<glGenBuffers>(1, &_ibo);
+    opengl_fn<glBindBuffer>(GL_ELEMENT_ARRAY_BUFFER, _ibo);
+    opengl_fn<glBufferData>(GL_ELEMENT_ARRAY_BUFFER,
+                            _nIndices * sizeof(uint32_t),
+                            nullptr,
+                            GL_STATIC_DRAW);
+
+    // position
+    opengl_fn<glVertexAttribPointer>(0,
+                                     3,
+                                     GL_FLOAT,
+                                     GL_FALSE,
+                                     floats_per_vertex * sizeof(float),
+                                     (void*)0);
+    opengl_fn<glEnableVertexAttribArray>(0);
+
+    // color
+    opengl_fn<glVertexAttribPointer>(1,
+                                     3,
+                                     GL_FLOAT,
+                                     GL_FALSE,
+                                     floats_per_vertex * sizeof(float),
+                                     (void*)(3 * sizeof(float)));
+    opengl_fn<glEnableVertexAttribArray>(1);
+
+    unbind();
+  }
+
+  void delete_buffers()
+  {
+    if (_vbo)
+    {
+      opengl_fn<glDeleteBuffers>(1, &_vbo);
+    }
+
+    if (_ibo)
+    {
+      opengl_fn<glDeleteBuffers>(1, &_ibo);
+    }
+
+    if (_vao)
+    {
+      opengl_fn<glDeleteVertexArrays>(1, &_vao);
+    }
+  }
+};
+
+} // namespace cgns_tools::gui
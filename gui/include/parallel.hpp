@@ -0,0 +1,549 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+namespace detail
+{
+
+/// completion of a task and the work waiting for it
+struct taskNode
+{
+  /// mark the task finished and start its successors
+  void finish()
+  {
+    std::vector<std::function<void()>> successors;
+    {
+      std::lock_guard lock{ _mutex };
+      _done = true;
+      successors.swap(_successors);
+    }
+    for (auto& successor : successors)
+    {
+      successor();
+    }
+  }
+
+  /// call f once the task finished, right away if it already has
+  void on_finish(std::function<void()> f)
+  {
+    {
+      std::lock_guard lock{ _mutex };
+      if (!_done)
+      {
+        _successors.push_back(std::move(f));
+        return;
+      }
+    }
+    f();
+  }
+
+private:
+  std::mutex _mutex;
+  bool _done = false;
+  std::vector<std::function<void()>> _successors;
+};
+
+} // namespace detail
+
+/// handle of a task started by threadPool::run, other tasks may depend on it
+template<typename T>
+struct task
+{
+  std::future<T> result;
+  std::shared_ptr<detail::taskNode> node;
+
+  bool valid() const noexcept { return result.valid(); }
+
+  bool ready() const
+  {
+    return result.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+
+  /// result of the task, blocks until it finished
+  T get() { return result.get(); }
+};
+
+/// fixed size pool of worker threads with one task deque per worker
+///
+/// Tasks submitted by a worker, e.g. the helpers of a nested parallel_for, go
+/// to its own deque and are taken newest first while their data is still in
+/// the cache. Tasks from other threads go to a shared FIFO queue. A worker
+/// without tasks takes from the shared queue and then steals the oldest task
+/// of another worker. Idle workers sleep until new tasks arrive.
+struct threadPool
+{
+  /// counters since construction or the last reset_stats
+  struct stats
+  {
+    std::size_t nWorkers = 0;
+    std::size_t nTasks = 0;
+    std::size_t nSteals = 0;  ///< tasks taken from another worker
+    double idleSeconds = 0.0; ///< summed over all workers
+    double seconds = 0.0;     ///< wall time
+
+    /// fraction of the worker time spent waiting for tasks
+    double idle_fraction() const noexcept
+    {
+      return nWorkers > 0 && seconds > 0.0
+               ? std::min(idleSeconds / (double(nWorkers) * seconds), 1.0)
+               : 0.0;
+    }
+  };
+
+  /// constructor
+  explicit threadPool(
+    const std::size_t nThreads =
+      std::max(2u, std::thread::hardware_concurrency()) - 1)
+    : _statsStart{ now() }
+  {
+    _queues.reserve(nThreads);
+    for (std::size_t i = 0; i < nThreads; ++i)
+    {
+      _queues.push_back(std::make_unique<workerQueue>());
+    }
+
+    _workers.reserve(nThreads);
+    for (std::size_t i = 0; i < nThreads; ++i)
+    {
+      _workers.emplace_back(
+        [this, i]
+        {
+          trace::set_thread_name("worker " + std::to_string(i));
+          work(i);
+        });
+    }
+  }
+
+  /// destructor, finishes all queued tasks before joining
+  ~threadPool()
+  {
+    {
+      std::lock_guard lock{ _mutex };
+      _stop = true;
+    }
+    _condition.notify_all();
+
+    for (auto& worker : _workers)
+    {
+      worker.join();
+    }
+  }
+
+  threadPool(const threadPool& other) = delete;
+  threadPool& operator=(const threadPool& other) = delete;
+
+  std::size_t size() const noexcept { return _workers.size(); }
+
+  /// enqueue a task, the returned future holds its result
+  template<typename F>
+  auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+  {
+    using result_t = std::invoke_result_t<std::decay_t<F>>;
+
+    auto task =
+      std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    enqueue([task] { (*task)(); });
+    return future;
+  }
+
+  /// enqueue a task that other tasks may depend on
+  template<typename F>
+  auto run(F&& f) -> task<std::invoke_result_t<std::decay_t<F>>>
+  {
+    return run_after(std::forward<F>(f));
+  }
+
+  /// enqueue f once all dependencies finished
+  ///
+  /// No thread waits for the dependencies, the last one to finish enqueues f.
+  /// Failed dependencies count as finished, their exceptions stay in their
+  /// results.
+  template<typename F, typename... Ts>
+  auto run_after(F&& f, const task<Ts>&... dependencies)
+    -> task<std::invoke_result_t<std::decay_t<F>>>
+  {
+    using result_t = std::invoke_result_t<std::decay_t<F>>;
+
+    auto work =
+      std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(f));
+    auto node = std::make_shared<detail::taskNode>();
+    task<result_t> result{ work->get_future(), node };
+
+    // one count per dependency and one for this call
+    auto remaining =
+      std::make_shared<std::atomic<std::size_t>>(sizeof...(Ts) + 1);
+    const auto release = [this, work, node, remaining]
+    {
+      if (remaining->fetch_sub(1) == 1)
+      {
+        enqueue(
+          [work, node]
+          {
+            (*work)();
+            node->finish();
+          });
+      }
+    };
+    (dependencies.node->on_finish(release), ...);
+    release();
+
+    return result;
+  }
+
+  /// continuation, enqueue f(future) once t finished
+  ///
+  /// f receives the future of t and thereby its result or exception.
+  template<typename T, typename F>
+  auto then(task<T>&& t, F&& f)
+    -> task<std::invoke_result_t<std::decay_t<F>&, std::future<T>>>
+  {
+    return run_after(
+      [future = std::move(t.result), f = std::forward<F>(f)]() mutable
+      { return f(std::move(future)); },
+      t);
+  }
+
+  stats statistics() const
+  {
+    stats result;
+    result.nWorkers = size();
+    for (const auto& queue : _queues)
+    {
+      result.nTasks += queue->nTasks.load(std::memory_order_relaxed);
+      result.nSteals += queue->nSteals.load(std::memory_order_relaxed);
+      result.idleSeconds +=
+        1e-9 * double(queue->idleNanoseconds.load(std::memory_order_relaxed));
+    }
+    result.seconds = 1e-9 * double(now() - _statsStart.load());
+    return result;
+  }
+
+  void reset_stats()
+  {
+    for (auto& queue : _queues)
+    {
+      queue->nTasks = 0;
+      queue->nSteals = 0;
+      queue->idleNanoseconds = 0;
+    }
+    _statsStart = now();
+  }
+
+private:
+  /// tasks submitted by one worker and its counters
+  struct workerQueue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+    std::atomic<std::size_t> nTasks{ 0 };
+    std::atomic<std::size_t> nSteals{ 0 };
+    std::atomic<int64_t> idleNanoseconds{ 0 };
+  };
+
+  /// pool and index of the worker running on the calling thread
+  struct workerId
+  {
+    const threadPool* pool = nullptr;
+    std::size_t index = 0;
+  };
+
+  std::vector<std::unique_ptr<workerQueue>> _queues;
+  std::vector<std::thread> _workers;
+
+  std::mutex _mutex; ///< shared queue and sleeping
+  std::deque<std::function<void()>> _tasks;
+  std::condition_variable _condition;
+  std::atomic<std::size_t> _nQueued{ 0 };
+  std::atomic<std::size_t> _nSleeping{ 0 };
+  bool _stop = false;
+
+  std::atomic<int64_t> _statsStart;
+
+  static int64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+  }
+
+  static workerId& current_worker()
+  {
+    static thread_local workerId id{};
+    return id;
+  }
+
+  void enqueue(std::function<void()> task)
+  {
+    const workerId& id = current_worker();
+    if (id.pool == this)
+    {
+      auto& queue = *_queues[id.index];
+      std::lock_guard lock{ queue.mutex };
+      queue.tasks.push_back(std::move(task));
+    }
+    else
+    {
+      std::lock_guard lock{ _mutex };
+      _tasks.push_back(std::move(task));
+    }
+
+    // sleepers count themselves before checking _nQueued, one of both sides
+    // sees the other
+    ++_nQueued;
+    if (_nSleeping > 0)
+    {
+      {
+        std::lock_guard lock{ _mutex };
+      }
+      _condition.notify_one();
+    }
+  }
+
+  /// next task of worker i: its own newest, the shared oldest or a stolen one
+  bool take(const std::size_t i, std::function<void()>& task)
+  {
+    auto& own = *_queues[i];
+    {
+      std::lock_guard lock{ own.mutex };
+      if (!own.tasks.empty())
+      {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+
+    {
+      std::lock_guard lock{ _mutex };
+      if (!_tasks.empty())
+      {
+        task = std::move(_tasks.front());
+        _tasks.pop_front();
+        return true;
+      }
+    }
+
+    for (std::size_t n = 1; n < _queues.size(); ++n)
+    {
+      auto& victim = *_queues[(i + n) % _queues.size()];
+      std::lock_guard lock{ victim.mutex };
+      if (!victim.tasks.empty())
+      {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        own.nSteals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void work(const std::size_t i)
+  {
+    current_worker() = { this, i };
+    auto& own = *_queues[i];
+
+    while (true)
+    {
+      std::function<void()> task;
+      if (take(i, task))
+      {
+        --_nQueued;
+        task();
+        own.nTasks.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+
+      const int64_t start = now();
+      std::unique_lock lock{ _mutex };
+      ++_nSleeping;
+      _condition.wait(lock, [this] { return _stop || _nQueued > 0; });
+      --_nSleeping;
+      own.idleNanoseconds.fetch_add(now() - start, std::memory_order_relaxed);
+
+      if (_stop && _nQueued == 0)
+      {
+        return;
+      }
+    }
+  }
+};
+
+/// process wide pool shared by all parallel algorithms
+inline threadPool&
+default_pool()
+{
+  static threadPool pool{};
+  return pool;
+}
+
+/// call f(i) for all i in [begin, end) in chunks of grain indices
+///
+/// The calling thread takes part in processing the chunks and only waits for
+/// chunks already picked up by workers. Nested calls from within pool tasks
+/// therefore cannot deadlock, their helpers go to the deque of the calling
+/// worker where idle workers steal them.
+template<typename F>
+void
+parallel_for(const std::size_t begin,
+             const std::size_t end,
+             const std::size_t grain,
+             F&& f,
+             threadPool& pool = default_pool())
+{
+  if (end <= begin)
+  {
+    return;
+  }
+
+  const std::size_t chunk = std::max<std::size_t>(grain, 1);
+  const std::size_t nChunks = (end - begin + chunk - 1) / chunk;
+
+  if (nChunks == 1)
+  {
+    for (std::size_t i = begin; i < end; ++i)
+    {
+      f(i);
+    }
+    return;
+  }
+
+  struct state
+  {
+    std::atomic<std::size_t> next{ 0 };
+    std::size_t done = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+
+  // shared ownership, helpers that start after completion only touch state
+  auto s = std::make_shared<state>();
+
+  const auto run = [s, begin, end, chunk, nChunks, &f]
+  {
+    while (true)
+    {
+      const std::size_t iChunk = s->next.fetch_add(1);
+      if (iChunk >= nChunks)
+      {
+        return;
+      }
+
+      try
+      {
+        const std::size_t first = begin + iChunk * chunk;
+        const std::size_t last = std::min(first + chunk, end);
+        for (std::size_t i = first; i < last; ++i)
+        {
+          f(i);
+        }
+      }
+      catch (...)
+      {
+        std::lock_guard lock{ s->mutex };
+        if (!s->error)
+        {
+          s->error = std::current_exception();
+        }
+      }
+
+      std::lock_guard lock{ s->mutex };
+      if (++s->done == nChunks)
+      {
+        s->condition.notify_all();
+      }
+    }
+  };
+
+  const std::size_t nHelpers = std::min(pool.size(), nChunks - 1);
+  for (std::size_t i = 0; i < nHelpers; ++i)
+  {
+    pool.submit(run);
+  }
+
+  run();
+
+  std::unique_lock lock{ s->mutex };
+  s->condition.wait(lock, [&] { return s->done == nChunks; });
+
+  if (s->error)
+  {
+    std::rethrow_exception(s->error);
+  }
+}
+
+/// tasks run on the GL thread, e.g. buffer uploads of results computed on the
+/// pool
+struct mainThreadQueue
+{
+  /// enqueue a task for the next drain, the returned future holds its result
+  template<typename F>
+  auto post(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+  {
+    using result_t = std::invoke_result_t<std::decay_t<F>>;
+
+    auto task =
+      std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    {
+      std::lock_guard lock{ _mutex };
+      _tasks.emplace_back([task] { (*task)(); });
+    }
+    return future;
+  }
+
+  /// run all queued tasks, tasks posted meanwhile wait for the next drain
+  std::size_t drain()
+  {
+    std::deque<std::function<void()>> tasks;
+    {
+      std::lock_guard lock{ _mutex };
+      tasks.swap(_tasks);
+    }
+    for (auto& task : tasks)
+    {
+      task();
+    }
+    return tasks.size();
+  }
+
+private:
+  std::mutex _mutex;
+  std::deque<std::function<void()>> _tasks;
+};
+
+/// queue drained by the main loop once per frame
+inline mainThreadQueue&
+gl_queue()
+{
+  static mainThreadQueue queue{};
+  return queue;
+}
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,167 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+namespace detail
+{
+
+inline const std::array<uint32_t, 256>&
+crc_table()
+{
+  static const auto table = []
+  {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t n = 0; n < 256; ++n)
+    {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+      {
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      t[n] = c;
+    }
+    return t;
+  }();
+  return table;
+}
+
+inline uint32_t
+crc32(const uint8_t* data, const std::size_t size, uint32_t crc = 0)
+{
+  const auto& table = crc_table();
+  crc = ~crc;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+inline void
+put_u32(std::vector<uint8_t>& out, const uint32_t v)
+{
+  out.push_back(uint8_t(v >> 24));
+  out.push_back(uint8_t(v >> 16));
+  out.push_back(uint8_t(v >> 8));
+  out.push_back(uint8_t(v));
+}
+
+inline void
+put_chunk(std::vector<uint8_t>& out,
+          const std::string_view type,
+          const std::vector<uint8_t>& data)
+{
+  put_u32(out, uint32_t(data.size()));
+  const auto begin = out.size();
+  out.insert(out.end(), type.begin(), type.end());
+  out.insert(out.end(), data.begin(), data.end());
+  put_u32(out, crc32(out.data() + begin, out.size() - begin));
+}
+
+} // namespace detail
+
+/// encode 8 bit RGBA pixels as PNG
+///
+/// The image data is written as stored (uncompressed) deflate blocks, which
+/// needs no compression library and keeps encoding memory bound. Rows are
+/// given bottom to top, as returned by glReadPixels.
+inline std::vector<uint8_t>
+encode_png(const uint8_t* rgba, const uint32_t width, const uint32_t height)
+{
+  const std::size_t rowSize = 4 * std::size_t(width);
+
+  // zlib stream: header, stored blocks of at most 65535 bytes, adler32
+  std::vector<uint8_t> z;
+  const std::size_t rawSize = (rowSize + 1) * height;
+  z.reserve(rawSize + 5 * (rawSize / 65535 + 1) + 6);
+  z.push_back(0x78);
+  z.push_back(0x01);
+
+  uint32_t a = 1;
+  uint32_t b = 0;
+  std::vector<uint8_t> block;
+  block.reserve(65535);
+
+  const auto flush = [&](const bool last)
+  {
+    const auto n = uint16_t(block.size());
+    z.push_back(last ? 1 : 0);
+    z.push_back(uint8_t(n));
+    z.push_back(uint8_t(n >> 8));
+    z.push_back(uint8_t(~n));
+    z.push_back(uint8_t(~n >> 8));
+    z.insert(z.end(), block.begin(), block.end());
+    block.clear();
+  };
+
+  const auto put = [&](const uint8_t* data, std::size_t size)
+  {
+    while (size > 0)
+    {
+      const auto n = std::min(size, std::size_t(65535) - block.size());
+      block.insert(block.end(), data, data + n);
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+      }
+      data += n;
+      size -= n;
+      if (block.size() == 65535)
+      {
+        flush(false);
+      }
+    }
+  };
+
+  for (uint32_t y = 0; y < height; ++y)
+  {
+    const uint8_t filter = 0;
+    put(&filter, 1);
+    put(rgba + (height - 1 - y) * rowSize, rowSize);
+  }
+  flush(true);
+  detail::put_u32(z, (b << 16) | a);
+
+  std::vector<uint8_t> header;
+  detail::put_u32(header, width);
+  detail::put_u32(header, height);
+  // 8 bit depth, RGBA, deflate, adaptive filtering, no interlace
+  header.insert(header.end(), { 8, 6, 0, 0, 0 });
+
+  std::vector<uint8_t> png{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  png.reserve(z.size() + 64);
+  detail::put_chunk(png, "IHDR", header);
+  detail::put_chunk(png, "IDAT", z);
+  detail::put_chunk(png, "IEND", {});
+  return png;
+}
+
+/// write 8 bit RGBA pixels, rows bottom to top, as PNG file
+inline bool
+write_png(const std::filesystem::path& path,
+          const uint8_t* rgba,
+          const uint32_t width,
+          const uint32_t height)
+{
+  const auto png = encode_png(rgba, width, height);
+
+  std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+  file.write(reinterpret_cast<const char*>(png.data()), png.size());
+  return bool(file);
+}
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,201 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "helpers.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <glad/glad.h>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// 64 bit FNV-1a hash, stable across runs and platforms
+inline uint64_t
+fnv1a(std::string_view data, uint64_t hash = 0xcbf29ce484222325ull)
+{
+  for (const unsigned char c : data)
+  {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/// on disk cache of linked program binaries
+///
+/// Entries are keyed by a hash of the shader sources and the driver strings,
+/// a driver update therefore never loads a stale binary.
+struct programCache
+{
+  /// default cache location, $XDG_CACHE_HOME or ~/.cache, falling back to
+  /// the temporary directory
+  static std::filesystem::path default_directory()
+  {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    {
+      return std::filesystem::path{ xdg } / "cgns-tools-gui" / "shaders";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home)
+    {
+      return std::filesystem::path{ home } / ".cache" / "cgns-tools-gui" /
+             "shaders";
+    }
+    return std::filesystem::temp_directory_path() / "cgns-tools-gui-shaders";
+  }
+
+  /// constructor, requires a current GL context
+  explicit programCache(std::filesystem::path directory = default_directory())
+    : _directory{ std::move(directory) }
+    , _driver{}
+    , _supported{ false }
+  {
+    // the format count is an invalid enum without ARB_get_program_binary
+    if (glGetProgramBinary && glProgramBinary)
+    {
+      GLint nFormats = 0;
+      opengl_fn<glGetIntegerv>(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+      _supported = nFormats > 0;
+    }
+
+    for (const auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+    {
+      if (const auto* str = opengl_fn<glGetString>(name))
+      {
+        _driver += reinterpret_cast<const char*>(str);
+      }
+      _driver += '\n';
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(_directory, ec);
+    if (ec)
+    {
+      _supported = false;
+    }
+  }
+
+  bool supported() const noexcept { return _supported; }
+
+  /// cache key of a program
+  std::string key(std::string_view vertexSource,
+                  std::string_view fragmentSource) const
+  {
+    uint64_t hash = fnv1a(_driver);
+    hash = fnv1a(vertexSource, hash);
+    hash = fnv1a(std::string_view{ "\0", 1 }, hash);
+    hash = fnv1a(fragmentSource, hash);
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return hex;
+  }
+
+  /// linked program from the cache, nullopt on a miss or if the driver
+  /// rejects the binary
+  std::optional<GLuint> load(const std::string& key) const
+  {
+    if (!_supported)
+    {
+      return std::nullopt;
+    }
+
+    std::ifstream file{ path(key), std::ios::binary };
+    if (!file)
+    {
+      return std::nullopt;
+    }
+
+    GLenum format = 0;
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    const std::vector<char> binary{ std::istreambuf_iterator<char>{ file },
+                                    std::istreambuf_iterator<char>{} };
+    if (!file.eof() || binary.empty())
+    {
+      return std::nullopt;
+    }
+
+    const auto program = opengl_fn<glCreateProgram>();
+
+    // a rejected binary is reported through the link status, an unknown
+    // format additionally raises GL_INVALID_ENUM which must not throw here
+    glProgramBinary(program, format, binary.data(), binary.size());
+    while (glGetError() != GL_NO_ERROR)
+    {
+    }
+
+    GLint success = 0;
+    opengl_fn<glGetProgramiv>(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+      opengl_fn<glDeleteProgram>(program);
+      return std::nullopt;
+    }
+
+    return program;
+  }
+
+  /// write the binary of a linked program to the cache
+  void store(const std::string& key, const GLuint program) const
+  {
+    if (!_supported || !program)
+    {
+      return;
+    }
+
+    GLint length = 0;
+    opengl_fn<glGetProgramiv>(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+      return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    opengl_fn<glGetProgramBinary>(
+      program, length, nullptr, &format, binary.data());
+
+    // write to a temporary file first, so concurrent instances never read a
+    // partially written entry
+    const auto target = path(key);
+    auto temporary = target;
+    temporary += ".tmp";
+    {
+      std::ofstream file{ temporary, std::ios::binary | std::ios::trunc };
+      file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+      file.write(binary.data(), binary.size());
+      if (!file)
+      {
+        std::cerr << "ERROR::PROGRAM_CACHE::WRITE_FAILED\n"
+                  << target.string() << std::endl;
+        return;
+      }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temporary, target, ec);
+  }
+
+private:
+  std::filesystem::path _directory;
+  std::string _driver;
+  bool _supported;
+
+  std::filesystem::path path(const std::string& key) const
+  {
+    return _directory / (key + ".bin");
+  }
+};
+
+} // namespace cgns_tools::gui
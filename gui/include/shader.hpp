@@ -4,120 +4,287 @@
 #pragma once
 
 #include "helpers.hpp"
+#include <algorithm>
+#include <functional>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
-#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace cgns_tools::gui
 {
 
+/// transparent hash for lookups by std::string_view without allocation
+struct stringHash
+{
+  using is_transparent = void;
+
+  std::size_t operator()(std::string_view s) const noexcept
+  {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
+/// compile and link a program, returns 0 and prints the log on failure
+inline GLuint
+build_program(const char* vertexShaderSource, const char* fragmentShaderSource)
+{
+  int success;
+  char infoLog[512];
+  bool ok = true;
+
+  // vertex shader
+  const auto vertexShader = opengl_fn<glCreateShader>(GL_VERTEX_SHADER);
+  opengl_fn<glShaderSource>(vertexShader, 1, &vertexShaderSource, nullptr);
+  opengl_fn<glCompileShader>(vertexShader);
+  opengl_fn<glGetShaderiv>(vertexShader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    opengl_fn<glGetShaderInfoLog>(vertexShader, 512, nullptr, infoLog);
+    std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
+              << infoLog << std::endl;
+    ok = false;
+  }
+
+  // fragment shader
+  unsigned int fragmentShader;
+  fragmentShader = opengl_fn<glCreateShader>(GL_FRAGMENT_SHADER);
+  opengl_fn<glShaderSource>(fragmentShader, 1, &fragmentShaderSource, nullptr);
+  opengl_fn<glCompileShader>(fragmentShader);
+  opengl_fn<glGetShaderiv>(fragmentShader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    opengl_fn<glGetShaderInfoLog>(fragmentShader, 512, nullptr, infoLog);
+    std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
+              << infoLog << std::endl;
+    ok = false;
+  }
+
+  // link shaders to shader program, keeping the binary retrievable for the
+  // program cache
+  GLuint program = opengl_fn<glCreateProgram>();
+  if (glProgramParameteri)
+  {
+    opengl_fn<glProgramParameteri>(
+      program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  opengl_fn<glAttachShader>(program, vertexShader);
+  opengl_fn<glAttachShader>(program, fragmentShader);
+  opengl_fn<glLinkProgram>(program);
+  opengl_fn<glGetProgramiv>(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    opengl_fn<glGetProgramInfoLog>(program, 512, nullptr, infoLog);
+    std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
+              << infoLog << std::endl;
+    ok = false;
+  }
+
+  opengl_fn<glDeleteShader>(vertexShader);
+  opengl_fn<glDeleteShader>(fragmentShader);
+
+  if (!ok)
+  {
+    opengl_fn<glDeleteProgram>(program);
+    return 0;
+  }
+
+  return program;
+}
+
+/// linked program with cached uniform locations
 struct shader
 {
-  shader() { compile(); }
+  /// compile from sources
+  shader(const char* vertexSource, const char* fragmentSource)
+    : shader(build_program(vertexSource, fragmentSource))
+  {
+  }
+
+  /// take ownership of a linked program
+  explicit shader(const GLuint program)
+    : _shaderProgram{ program }
+  {
+    reflect_uniforms();
+  }
+
+  ~shader()
+  {
+    if (_shaderProgram)
+    {
+      opengl_fn<glDeleteProgram>(_shaderProgram);
+    }
+  }
 
-  ~shader() { opengl_fn<glDeleteProgram>(_shaderProgram); }
+  shader(const shader& other) = delete;
+  shader& operator=(const shader& other) = delete;
 
   void use() const { opengl_fn<glUseProgram>(_shaderProgram); }
 
-  // void set_mat4(const glm::mat4& mat4, const std::string& name)
-  // {
-  //   GLint myLoc = glGetUniformLocation(_shaderProgram, name.c_str());
-  //   glUniformMatrix4fv(myLoc, 1, GL_FALSE, glm::value_ptr(mat4));
-  // }
+  GLuint id() const noexcept { return _shaderProgram; }
 
-  // void set_vec3(const glm::vec3& vec3, const std::string& name)
-  // {
-  //   GLint myLoc = glGetUniformLocation(_shaderProgram, name.c_str());
-  //   glProgramUniform3fv(_shaderProgram, myLoc, 1, glm::value_ptr(vec3));
-  // }
+  /// replace the program, e.g. after the sources changed, uniform locations
+  /// and block bindings are updated
+  void replace(const GLuint program)
+  {
+    if (_shaderProgram)
+    {
+      opengl_fn<glDeleteProgram>(_shaderProgram);
+    }
+    _shaderProgram = program;
 
-  // void set_f1(float v, const std::string& name)
-  // {
-  //   GLint myLoc = glGetUniformLocation(_shaderProgram, name.c_str());
-  //   glUniform1f(myLoc, v);
-  // }
+    reflect_uniforms();
 
-private:
-  uint32_t _shaderProgram;
+    const auto blocks = std::move(_blocks);
+    _blocks.clear();
+    for (const auto& [name, binding] : blocks)
+    {
+      bind_block(name.c_str(), binding);
+    }
+  }
+
+  /// location of an active uniform, -1 if the program has no such uniform
+  ///
+  /// Locations are queried once after linking, the lookup does not involve
+  /// the driver. Uniforms in blocks have no location.
+  GLint location(std::string_view name) const
+  {
+    const auto it = _uniforms.find(name);
+    return it != _uniforms.end() ? it->second : -1;
+  }
+
+  /// bind the uniform block name to a uniform buffer binding point, programs
+  /// without such a block are left untouched
+  void bind_block(const char* name, const GLuint binding)
+  {
+    _blocks.emplace_back(name, binding);
 
-  // const char* vertexShaderSource =
-  //   "#version 330 core\n"
-  //   "layout (location = 0) in vec3 aPosition;\n"
-  //   "\n"
-  //   // "uniform mat4 model;\n"
-  //   // "uniform mat4 view;\n"
-  //   // "uniform mat4 projection;\n"
-  //   "\n"
-  //   "void main()\n"
-  //   "{\n"
-  //   // "   gl_Position = projection * view * model *
-  //   vec4(aPosition, 1.0f);\n" "   gl_Position = vec4(aPosition, 1.0f);\n"
-  //   "}\n";
-
-  const char* vertexShaderSource =
-    "#version 330 core\n"
-    "layout (location = 0) in vec3 aPos;\n"
-    "void main()\n"
-    "{\n"
-    "   gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);\n"
-    "}\0";
-
-  const char* fragmentShaderSource =
-    "#version 330 core\n"
-    "out vec4 FragColor;\n"
-    "void main()\n"
-    "{\n"
-    "    FragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);\n"
-    "}\n";
-
-  void compile()
-  {
-    int success;
-    char infoLog[512];
-
-    // vertex shader
-    const auto vertexShader = opengl_fn<glCreateShader>(GL_VERTEX_SHADER);
-    opengl_fn<glShaderSource>(vertexShader, 1, &vertexShaderSource, nullptr);
-    opengl_fn<glCompileShader>(vertexShader);
-    opengl_fn<glGetShaderiv>(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    if (!_shaderProgram)
     {
-      opengl_fn<glGetShaderInfoLog>(vertexShader, 512, nullptr, infoLog);
-      std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
-                << infoLog << std::endl;
+      return;
     }
 
-    // fragment shader
-    unsigned int fragmentShader;
-    fragmentShader = opengl_fn<glCreateShader>(GL_FRAGMENT_SHADER);
-    opengl_fn<glShaderSource>(
-      fragmentShader, 1, &fragmentShaderSource, nullptr);
-    opengl_fn<glCompileShader>(fragmentShader);
-    opengl_fn<glGetShaderiv>(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    const auto index =
+      opengl_fn<glGetUniformBlockIndex>(_shaderProgram, name);
+    if (index != GL_INVALID_INDEX)
     {
-      opengl_fn<glGetShaderInfoLog>(fragmentShader, 512, nullptr, infoLog);
-      std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
-                << infoLog << std::endl;
+      opengl_fn<glUniformBlockBinding>(_shaderProgram, index, binding);
     }
+  }
+
+  // the setters act on the program in use
+
+  void set_mat4(const glm::mat4& mat4, const GLint location) const
+  {
+    opengl_fn<glUniformMatrix4fv>(
+      location, 1, GL_FALSE, glm::value_ptr(mat4));
+  }
+
+  void set_vec2(const glm::vec2& vec2, const GLint location) const
+  {
+    opengl_fn<glUniform2fv>(location, 1, glm::value_ptr(vec2));
+  }
+
+  void set_vec3(const glm::vec3& vec3, const GLint location) const
+  {
+    opengl_fn<glUniform3fv>(location, 1, glm::value_ptr(vec3));
+  }
+
+  void set_f1(const float v, const GLint location) const
+  {
+    opengl_fn<glUniform1f>(location, v);
+  }
+
+  void set_i1(const int v, const GLint location) const
+  {
+    opengl_fn<glUniform1i>(location, v);
+  }
+
+  void set_ivec3(const glm::ivec3& v, const GLint location) const
+  {
+    opengl_fn<glUniform3i>(location, v.x, v.y, v.z);
+  }
+
+  void set_mat4(const glm::mat4& mat4, std::string_view name) const
+  {
+    set_mat4(mat4, location(name));
+  }
 
-    // link shaders to shader program
-    _shaderProgram = opengl_fn<glCreateProgram>();
-    opengl_fn<glAttachShader>(_shaderProgram, vertexShader);
-    opengl_fn<glAttachShader>(_shaderProgram, fragmentShader);
-    opengl_fn<glLinkProgram>(_shaderProgram);
-    opengl_fn<glGetProgramiv>(_shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
+  void set_vec2(const glm::vec2& vec2, std::string_view name) const
+  {
+    set_vec2(vec2, location(name));
+  }
+
+  void set_vec3(const glm::vec3& vec3, std::string_view name) const
+  {
+    set_vec3(vec3, location(name));
+  }
+
+  void set_f1(const float v, std::string_view name) const
+  {
+    set_f1(v, location(name));
+  }
+
+  void set_i1(const int v, std::string_view name) const
+  {
+    set_i1(v, location(name));
+  }
+
+  void set_ivec3(const glm::ivec3& v, std::string_view name) const
+  {
+    set_ivec3(v, location(name));
+  }
+
+private:
+  uint32_t _shaderProgram;
+  std::unordered_map<std::string, GLint, stringHash, std::equal_to<>>
+    _uniforms;
+  std::vector<std::pair<std::string, GLuint>> _blocks;
+
+  /// cache the locations of all active uniforms
+  void reflect_uniforms()
+  {
+    _uniforms.clear();
+
+    if (!_shaderProgram)
     {
-      opengl_fn<glGetProgramInfoLog>(_shaderProgram, 512, nullptr, infoLog);
-      std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
-                << infoLog << std::endl;
+      return;
     }
 
-    opengl_fn<glDeleteShader>(vertexShader);
-    opengl_fn<glDeleteShader>(fragmentShader);
+    GLint nUniforms = 0;
+    opengl_fn<glGetProgramiv>(_shaderProgram, GL_ACTIVE_UNIFORMS, &nUniforms);
+    GLint maxLength = 0;
+    opengl_fn<glGetProgramiv>(
+      _shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::string name(std::max(maxLength, 1), '\0');
+    for (GLint i = 0; i < nUniforms; ++i)
+    {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      opengl_fn<glGetActiveUniform>(_shaderProgram,
+                                    i,
+                                    maxLength,
+                                    &length,
+                                    &size,
+                                    &type,
+                                    name.data());
+
+      const std::string uniform{ name.data(),
+                                 static_cast<std::size_t>(length) };
+      const auto location =
+        opengl_fn<glGetUniformLocation>(_shaderProgram, uniform.c_str());
+      if (location >= 0)
+      {
+        _uniforms.emplace(uniform, location);
+      }
+    }
   }
 };
 
@@ -0,0 +1,208 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "programCache.hpp"
+#include "shader.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// named programs loaded from GLSL files, backed by the program binary cache
+/// and optionally recompiled when their sources change on disk
+struct shaderRegistry
+{
+  /// status of one program, for display
+  struct entry
+  {
+    std::string name;
+    std::filesystem::path vertexFile;
+    std::filesystem::path fragmentFile;
+    std::filesystem::file_time_type vertexTime;
+    std::filesystem::file_time_type fragmentTime;
+    std::unique_ptr<shader> program;
+
+    /// loaded from the binary cache rather than compiled
+    bool cached = false;
+    /// last load or reload failed, the previous program is still in use
+    bool failed = false;
+    /// duration of the last (re)load
+    double seconds = 0.0;
+  };
+
+  /// interval between two checks of the source files
+  static constexpr std::chrono::milliseconds poll_interval{ 500 };
+
+  /// recompile programs when their source files change
+  bool hotReload = false;
+
+  /// constructor, requires a current GL context
+  explicit shaderRegistry(std::filesystem::path directory)
+    : _directory{ std::move(directory) }
+    , _cache{}
+    , _entries{}
+    , _lastPoll{ std::chrono::steady_clock::now() }
+  {
+  }
+
+  /// load a program from files relative to the shader directory, the
+  /// returned reference stays valid across reloads
+  shader& add(std::string name,
+              const std::filesystem::path& vertexFile,
+              const std::filesystem::path& fragmentFile)
+  {
+    auto& e = _entries.emplace_back();
+    e.name = std::move(name);
+    e.vertexFile = _directory / vertexFile;
+    e.fragmentFile = _directory / fragmentFile;
+
+    auto program = load(e);
+    e.program = std::make_unique<shader>(program.value_or(0));
+
+    return *e.program;
+  }
+
+  /// program by name, nullptr if unknown
+  shader* get(std::string_view name)
+  {
+    for (auto& e : _entries)
+    {
+      if (e.name == name)
+      {
+        return e.program.get();
+      }
+    }
+    return nullptr;
+  }
+
+  /// bind a uniform block of all programs, kept across reloads
+  void bind_block(const char* name, const GLuint binding)
+  {
+    for (auto& e : _entries)
+    {
+      e.program->bind_block(name, binding);
+    }
+  }
+
+  /// recompile programs whose sources changed, call once per frame
+  void poll()
+  {
+    if (!hotReload)
+    {
+      return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _lastPoll < poll_interval)
+    {
+      return;
+    }
+    _lastPoll = now;
+
+    for (auto& e : _entries)
+    {
+      if (modified(e.vertexFile) == e.vertexTime &&
+          modified(e.fragmentFile) == e.fragmentTime)
+      {
+        continue;
+      }
+
+      // a failed build keeps the previous program
+      if (auto program = load(e))
+      {
+        e.program->replace(*program);
+      }
+    }
+  }
+
+  const std::vector<entry>& entries() const noexcept { return _entries; }
+
+private:
+  std::filesystem::path _directory;
+  programCache _cache;
+  std::vector<entry> _entries;
+  std::chrono::steady_clock::time_point _lastPoll;
+
+  static std::filesystem::file_time_type modified(
+    const std::filesystem::path& path)
+  {
+    std::error_code ec;
+    return std::filesystem::last_write_time(path, ec);
+  }
+
+  static std::optional<std::string> read_file(
+    const std::filesystem::path& path)
+  {
+    std::ifstream file{ path };
+    if (!file)
+    {
+      return std::nullopt;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+  }
+
+  /// build the program of e, reverted sources are served from the cache
+  std::optional<GLuint> load(entry& e)
+  {
+    const auto start = std::chrono::steady_clock::now();
+
+    // record the times first, a file changing while being read is picked up
+    // by the next poll
+    e.vertexTime = modified(e.vertexFile);
+    e.fragmentTime = modified(e.fragmentFile);
+
+    const auto vertexSource = read_file(e.vertexFile);
+    const auto fragmentSource = read_file(e.fragmentFile);
+    if (!vertexSource || !fragmentSource)
+    {
+      std::cerr << "ERROR::SHADER::" << e.name << "::READ_FAILED\n"
+                << _directory.string() << std::endl;
+      e.failed = true;
+      return std::nullopt;
+    }
+
+    const auto key = _cache.key(*vertexSource, *fragmentSource);
+
+    auto program = _cache.load(key);
+    e.cached = program.has_value();
+
+    if (!program)
+    {
+      if (const auto built =
+            build_program(vertexSource->c_str(), fragmentSource->c_str()))
+      {
+        program = built;
+        _cache.store(key, built);
+      }
+    }
+
+    e.failed = !program.has_value();
+    if (e.failed)
+    {
+      std::cerr << "ERROR::SHADER::" << e.name << "::BUILD_FAILED" << std::endl;
+    }
+
+    e.seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+
+    return program;
+  }
+};
+
+} // namespace cgns_tools::gui
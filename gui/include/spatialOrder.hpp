@@ -0,0 +1,212 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "parallel.hpp"
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// stable sort of keys and their values by a least significant digit radix
+/// sort with 8 bit digits
+///
+/// Each pass counts the digits per block in parallel, turns the counts into
+/// offsets ordered by digit and then block, and scatters the blocks in
+/// parallel. Digits equal in all keys are skipped.
+template<typename Value>
+void
+parallel_radix_sort(std::vector<uint64_t>& keys, std::vector<Value>& values)
+{
+  const trace::scope traceScope{ "radix sort", "convert" };
+
+  constexpr std::size_t block_size = std::size_t(1) << 16;
+  constexpr std::size_t n_digits = 256;
+
+  const std::size_t n = keys.size();
+  const std::size_t nBlocks = (n + block_size - 1) / block_size;
+  if (n < 2)
+  {
+    return;
+  }
+
+  // bits that differ between keys
+  std::vector<std::array<uint64_t, 2>> bits(nBlocks);
+  parallel_for(0,
+               nBlocks,
+               1,
+               [&](const std::size_t b)
+               {
+                 uint64_t any = 0;
+                 uint64_t all = ~uint64_t(0);
+                 const std::size_t end = std::min(n, (b + 1) * block_size);
+                 for (std::size_t i = b * block_size; i < end; ++i)
+                 {
+                   any |= keys[i];
+                   all &= keys[i];
+                 }
+                 bits[b] = { any, all };
+               });
+  uint64_t any = 0;
+  uint64_t all = ~uint64_t(0);
+  for (const auto& b : bits)
+  {
+    any |= b[0];
+    all &= b[1];
+  }
+  const uint64_t varying = any ^ all;
+
+  std::vector<uint64_t> keysOut(n);
+  std::vector<Value> valuesOut(n);
+  std::vector<std::array<std::size_t, n_digits>> offsets(nBlocks);
+
+  for (unsigned shift = 0; shift < 64; shift += 8)
+  {
+    if (((varying >> shift) & 0xff) == 0)
+    {
+      continue;
+    }
+
+    parallel_for(0,
+                 nBlocks,
+                 1,
+                 [&](const std::size_t b)
+                 {
+                   auto& count = offsets[b];
+                   count.fill(0);
+                   const std::size_t end = std::min(n, (b + 1) * block_size);
+                   for (std::size_t i = b * block_size; i < end; ++i)
+                   {
+                     ++count[(keys[i] >> shift) & 0xff];
+                   }
+                 });
+
+    std::size_t sum = 0;
+    for (std::size_t d = 0; d < n_digits; ++d)
+    {
+      for (auto& offset : offsets)
+      {
+        sum += std::exchange(offset[d], sum);
+      }
+    }
+
+    parallel_for(0,
+                 nBlocks,
+                 1,
+                 [&](const std::size_t b)
+                 {
+                   auto& offset = offsets[b];
+                   const std::size_t end = std::min(n, (b + 1) * block_size);
+                   for (std::size_t i = b * block_size; i < end; ++i)
+                   {
+                     const auto digit = (keys[i] >> shift) & 0xff;
+                     const std::size_t o = offset[digit]++;
+                     keysOut[o] = keys[i];
+                     valuesOut[o] = values[i];
+                   }
+                 });
+
+    std::swap(keys, keysOut);
+    std::swap(values, valuesOut);
+  }
+}
+
+namespace detail
+{
+
+/// the lower 19 bits of x moved to every third bit
+inline uint64_t
+spread_bits(uint64_t x)
+{
+  x &= 0x7ffff;
+  x = (x | x << 32) & 0x001f00000000ffffull;
+  x = (x | x << 16) & 0x001f0000ff0000ffull;
+  x = (x | x << 8) & 0x100f00f00f00f00full;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+  x = (x | x << 2) & 0x1249249249249249ull;
+  return x;
+}
+
+/// largest power of two dividing i, as exponent up to max_level
+inline unsigned
+lattice_level(const std::size_t i, const unsigned max_level)
+{
+  return std::min<unsigned>(std::countr_zero(uint32_t(i)), max_level);
+}
+
+} // namespace detail
+
+/// order of the points of a zone along a space-filling curve, position n of
+/// the reordered points holds point order[n] in i-j-k order
+///
+/// Points are grouped by the coarsest lattice they lie on: the first group
+/// holds the points whose indices are all multiples of 2^15, down to the
+/// points with an odd index last. Within a group the points follow a Morton
+/// curve through the bounds of the zone. Any prefix of the reordered points
+/// is thus the zone at a power of two stride, refined in a compact region,
+/// and neighbors in the buffer are neighbors in space.
+inline std::vector<uint32_t>
+spatial_order(const structuredZone& zone)
+{
+  const trace::scope traceScope{ "spatial order", "convert" };
+
+  // 4 bits of lattice level above 3 x axisBits of Morton code, the curve
+  // resolves a few cells per point and direction, less bits mean less passes
+  // of the radix sort
+  constexpr unsigned max_level = 15;
+  const std::size_t maxDim =
+    std::max({ zone.dims[0], zone.dims[1], zone.dims[2] });
+  const unsigned axisBits =
+    std::min<unsigned>(std::bit_width(maxDim) + 2, 19);
+
+  const std::size_t n = zone.n_points();
+  std::vector<uint64_t> keys(n);
+  std::vector<uint32_t> order(n);
+
+  const glm::vec3 extent =
+    glm::max(zone.bounds.max - zone.bounds.min, 1e-30f);
+  const float maxCode = float((1u << axisBits) - 1);
+  const glm::vec3 scale = maxCode / extent;
+
+  parallel_for(
+    0,
+    zone.dims[2],
+    1,
+    [&](const std::size_t k)
+    {
+      for (std::size_t j = 0; j < zone.dims[1]; ++j)
+      {
+        for (std::size_t i = 0; i < zone.dims[0]; ++i)
+        {
+          const std::size_t index = zone.index(i, j, k);
+          const glm::vec3 q = glm::clamp(
+            (zone.points[index] - zone.bounds.min) * scale, 0.0f, maxCode);
+          const uint64_t morton = detail::spread_bits(uint64_t(q.x)) |
+                                  detail::spread_bits(uint64_t(q.y)) << 1 |
+                                  detail::spread_bits(uint64_t(q.z)) << 2;
+          const unsigned l =
+            std::min({ detail::lattice_level(i, max_level),
+                       detail::lattice_level(j, max_level),
+                       detail::lattice_level(k, max_level) });
+
+          keys[index] = uint64_t(max_level - l) << (3 * axisBits) | morton;
+          order[index] = uint32_t(index);
+        }
+      }
+    });
+
+  parallel_radix_sort(keys, order);
+  return order;
+}
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,77 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// timestamps of named startup phases, relative to the construction of the
+/// profile at the top of main
+struct startupProfile
+{
+  using clock = std::chrono::steady_clock;
+
+  /// constructor
+  startupProfile()
+    : _start{ clock::now() }
+    , _phases{}
+    , _finished{ false }
+  {
+  }
+
+  /// seconds since start
+  double elapsed() const
+  {
+    return std::chrono::duration<double>(clock::now() - _start).count();
+  }
+
+  /// record the end of a phase, ignored once finished
+  void mark(std::string phase)
+  {
+    if (!_finished)
+    {
+      _phases.emplace_back(std::move(phase), elapsed());
+    }
+  }
+
+  /// record the last phase and print all phases as a single line,
+  /// e.g. for tracking the time to first image from job scripts
+  void finish(std::string phase)
+  {
+    if (_finished)
+    {
+      return;
+    }
+    mark(std::move(phase));
+    _finished = true;
+
+    std::printf("startup:");
+    double previous = 0.0;
+    for (const auto& [name, seconds] : _phases)
+    {
+      std::printf(" %s %.1f ms,", name.c_str(), 1e3 * (seconds - previous));
+      previous = seconds;
+    }
+    std::printf(" total %.1f ms\n", 1e3 * previous);
+    std::fflush(stdout);
+  }
+
+  bool finished() const noexcept { return _finished; }
+
+  /// phase names with their end time in seconds since start
+  const auto& phases() const noexcept { return _phases; }
+
+private:
+  clock::time_point _start;
+  std::vector<std::pair<std::string, double>> _phases;
+  bool _finished;
+};
+
+} // namespace cgns_tools::gui
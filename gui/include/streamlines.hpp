@@ -0,0 +1,626 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "cellLocator.hpp"
+#include "colormap.hpp"
+#include "cutPlane.hpp"
+#include "lineBuffer.hpp"
+#include "parallel.hpp"
+#include "shader.hpp"
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <future>
+#include <glm/glm.hpp>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+enum class seedShape
+{
+  rake, ///< seeds along the line from start to end
+  plane ///< seeds on a square grid in a plane
+};
+
+/// parameters of a streamline computation
+struct streamlineSettings
+{
+  /// velocity components
+  std::array<std::string, 3> velocity;
+
+  seedShape shape = seedShape::rake;
+  glm::vec3 start{ 0.0f, 0.0f, 0.0f };
+  glm::vec3 end{ 1.0f, 0.0f, 0.0f };
+  plane seedPlane;
+  float size = 1.0f; ///< edge length of the seed square
+
+  std::size_t nSeeds = 16; ///< seeds on the rake, per direction on the plane
+  std::size_t maxSteps = 1000;
+  float tolerance = 1e-3f; ///< error per step relative to the cell size
+  bool bothDirections = true;
+
+  bool operator==(const streamlineSettings& other) const = default;
+};
+
+/// streamlines as line strips, interleaved as in lineBuffer
+struct streamlineResult
+{
+  streamlineSettings settings;
+  std::vector<float> vertices;
+  std::vector<GLint> first;
+  std::vector<GLsizei> counts;
+  std::size_t nSeeds = 0;
+  std::size_t nPoints = 0;
+  std::size_t nSteps = 0; ///< accepted integration steps
+  double seconds = 0.0;
+
+  std::size_t n_lines() const { return counts.size(); }
+
+  double lines_per_second() const
+  {
+    return seconds > 0.0 ? n_lines() / seconds : 0.0;
+  }
+};
+
+namespace detail
+{
+
+/// seed points of the rake or plane
+inline std::vector<glm::vec3>
+streamline_seeds(const streamlineSettings& settings)
+{
+  const std::size_t n = std::max<std::size_t>(settings.nSeeds, 1);
+  const auto t = [n](const std::size_t i)
+  { return n > 1 ? float(i) / float(n - 1) : 0.5f; };
+
+  std::vector<glm::vec3> seeds;
+  if (settings.shape == seedShape::rake)
+  {
+    seeds.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      seeds.push_back(settings.start + t(i) * (settings.end - settings.start));
+    }
+    return seeds;
+  }
+
+  // orthonormal basis of the plane
+  const glm::vec3 normal = glm::normalize(settings.seedPlane.normal);
+  const glm::vec3 axis = std::abs(normal.x) < 0.9f ? glm::vec3{ 1, 0, 0 }
+                                                   : glm::vec3{ 0, 1, 0 };
+  const glm::vec3 u = glm::normalize(glm::cross(normal, axis));
+  const glm::vec3 v = glm::cross(normal, u);
+
+  seeds.reserve(n * n);
+  for (std::size_t j = 0; j < n; ++j)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      seeds.push_back(settings.seedPlane.origin +
+                      settings.size * ((t(i) - 0.5f) * u + (t(j) - 0.5f) * v));
+    }
+  }
+  return seeds;
+}
+
+/// velocity fields of all zones, compressed components are decoded on
+/// construction
+struct velocityField
+{
+  const std::vector<structuredZone>& zones;
+  const cellLocator& locator;
+  std::vector<std::array<std::optional<fieldValues>, 3>> components;
+
+  velocityField(const std::vector<structuredZone>& zones_,
+                const cellLocator& locator_,
+                const std::array<std::string, 3>& names)
+    : zones{ zones_ }
+    , locator{ locator_ }
+    , components(zones_.size())
+  {
+    for (std::size_t z = 0; z < zones.size(); ++z)
+    {
+      for (std::size_t d = 0; d < 3; ++d)
+      {
+        if (const auto* field = zones[z].field(names[d]))
+        {
+          components[z][d].emplace(*field);
+        }
+      }
+    }
+  }
+
+  /// trilinear interpolation of the velocity at a located point
+  std::optional<glm::vec3> operator()(const cellPosition& position) const
+  {
+    const auto& zone = zones[position.zone];
+    const auto& fields = components[position.zone];
+    if (!fields[0] || !fields[1] || !fields[2])
+    {
+      return std::nullopt;
+    }
+
+    const glm::vec3 x = position.local;
+    const glm::vec3 m = 1.0f - x;
+    glm::vec3 result{ 0.0f };
+    for (std::size_t k = 0; k < 8; ++k)
+    {
+      const std::size_t i = position.cell[0] + (k & 1);
+      const std::size_t j = position.cell[1] + ((k >> 1) & 1);
+      const std::size_t l = position.cell[2] + (k >> 2);
+      const float w = ((k & 1) ? x.x : m.x) * (((k >> 1) & 1) ? x.y : m.y) *
+                      ((k >> 2) ? x.z : m.z);
+
+      const std::size_t n = zone.index(i, j, l);
+      result +=
+        w * glm::vec3{ (*fields[0])[n], (*fields[1])[n], (*fields[2])[n] };
+    }
+    return result;
+  }
+
+  /// velocity at p, the hint is moved to the cell containing p
+  std::optional<glm::vec3> operator()(const glm::vec3& p,
+                                      cellPosition& hint) const
+  {
+    auto position = locator.locate(p, hint);
+    if (!position)
+    {
+      return std::nullopt;
+    }
+    hint = *position;
+    return (*this)(*position);
+  }
+};
+
+/// diagonal length of a cell
+inline float
+cell_length(const structuredZone& zone, const std::array<std::size_t, 3>& cell)
+{
+  return glm::length(
+    zone.points[zone.index(cell[0] + 1, cell[1] + 1, cell[2] + 1)] -
+    zone.points[zone.index(cell[0], cell[1], cell[2])]);
+}
+
+/// points and speeds of a single integration direction
+struct streamlinePath
+{
+  std::vector<glm::vec3> points;
+  std::vector<float> speeds;
+  std::size_t nSteps = 0;
+};
+
+/// integrate from the seed along direction * velocity
+///
+/// The path is parametrized by arc length, i.e. the unit velocity is
+/// integrated, so that the step size is a length in the order of the local
+/// cell size. Steps are RK4 with step doubling: the difference of one full
+/// and two half steps estimates the error, which controls the next step and
+/// corrects the result by Richardson extrapolation. Integration ends when
+/// the path leaves the domain, reaches a stagnation point or after maxSteps.
+inline streamlinePath
+integrate(const velocityField& velocity,
+          const cellPosition& seed,
+          const glm::vec3& origin,
+          const float direction,
+          const streamlineSettings& settings)
+{
+  // step size relative to the cell length
+  constexpr float min_step = 1e-3f;
+  constexpr float max_step = 1.0f;
+
+  streamlinePath path;
+  cellPosition hint = seed;
+
+  const auto v0 = velocity(seed);
+  if (!v0)
+  {
+    return path;
+  }
+  float speed = glm::length(*v0);
+  path.points.push_back(origin);
+  path.speeds.push_back(speed);
+
+  // stagnation relative to the speed at the seed, absolute at the seed
+  const float stagnation =
+    std::max(1e-6f * speed, std::numeric_limits<float>::min());
+
+  const auto direction_at =
+    [&](const glm::vec3& p) -> std::optional<glm::vec3>
+  {
+    const auto v = velocity(p, hint);
+    if (!v)
+    {
+      return std::nullopt;
+    }
+    const float length = glm::length(*v);
+    if (length < stagnation)
+    {
+      return std::nullopt;
+    }
+    return direction / length * *v;
+  };
+
+  const auto rk4 = [&](const glm::vec3& p,
+                       const glm::vec3& k1,
+                       const float h) -> std::optional<glm::vec3>
+  {
+    const auto k2 = direction_at(p + 0.5f * h * k1);
+    if (!k2)
+    {
+      return std::nullopt;
+    }
+    const auto k3 = direction_at(p + 0.5f * h * *k2);
+    if (!k3)
+    {
+      return std::nullopt;
+    }
+    const auto k4 = direction_at(p + h * *k3);
+    if (!k4)
+    {
+      return std::nullopt;
+    }
+    return p + h / 6.0f * (k1 + 2.0f * (*k2 + *k3) + *k4);
+  };
+
+  glm::vec3 p = origin;
+  cellPosition position = seed;
+  float length = cell_length(velocity.zones[seed.zone], seed.cell);
+  float h = 0.5f * length;
+
+  while (path.nSteps < settings.maxSteps)
+  {
+    hint = position;
+    const auto k1 = direction_at(p);
+    if (!k1)
+    {
+      break;
+    }
+
+    h = std::clamp(h, min_step * length, max_step * length);
+    const float tolerance = settings.tolerance * length;
+
+    const auto full = rk4(p, *k1, h);
+    const auto half = rk4(p, *k1, 0.5f * h);
+    std::optional<glm::vec3> twice;
+    if (full && half)
+    {
+      if (const auto k = direction_at(*half))
+      {
+        twice = rk4(*half, *k, 0.5f * h);
+      }
+    }
+
+    if (!twice)
+    {
+      // a stage left the domain, approach the boundary with smaller steps
+      if (h <= min_step * length)
+      {
+        break;
+      }
+      h *= 0.25f;
+      continue;
+    }
+
+    const glm::vec3 difference = *twice - *full;
+    const float error = glm::length(difference) / 15.0f;
+    const float factor =
+      error > 0.0f ? 0.9f * std::pow(tolerance / error, 0.2f) : 4.0f;
+
+    if (error > tolerance && h > min_step * length)
+    {
+      h *= std::max(factor, 0.1f);
+      continue;
+    }
+
+    // accept with the extrapolated fifth order result
+    const glm::vec3 next = *twice + difference / 15.0f;
+    hint = position;
+    const auto located = velocity.locator.locate(next, hint);
+    if (!located)
+    {
+      break;
+    }
+    const auto v = velocity(*located);
+    if (!v)
+    {
+      break;
+    }
+
+    p = next;
+    position = *located;
+    speed = glm::length(*v);
+    path.points.push_back(p);
+    path.speeds.push_back(speed);
+    ++path.nSteps;
+
+    if (speed < stagnation)
+    {
+      break;
+    }
+
+    length = cell_length(velocity.zones[position.zone], position.cell);
+    h *= std::min(factor, 4.0f);
+  }
+
+  return path;
+}
+
+} // namespace detail
+
+/// trace streamlines from the seeds of the settings through the velocity
+/// field, lines are colored by speed
+inline streamlineResult
+trace_streamlines(const std::vector<structuredZone>& zones,
+                  const streamlineSettings& settings)
+{
+  const trace::scope traceScope{ "trace streamlines", "streamlines" };
+  const auto start = std::chrono::steady_clock::now();
+
+  streamlineResult result;
+  result.settings = settings;
+
+  const cellLocator locator{ zones };
+  const detail::velocityField velocity{ zones, locator, settings.velocity };
+
+  const auto seeds = detail::streamline_seeds(settings);
+  result.nSeeds = seeds.size();
+
+  // lines differ widely in length, hand out single seeds
+  std::vector<detail::streamlinePath> paths(seeds.size());
+  parallel_for(
+    0,
+    seeds.size(),
+    1,
+    [&](const std::size_t i)
+    {
+      const auto seed = locator.locate(seeds[i]);
+      if (!seed)
+      {
+        return;
+      }
+
+      auto forward =
+        detail::integrate(velocity, *seed, seeds[i], 1.0f, settings);
+      if (!settings.bothDirections)
+      {
+        paths[i] = std::move(forward);
+        return;
+      }
+
+      // backward part reversed, followed by the forward part without the seed
+      auto& path = paths[i];
+      path = detail::integrate(velocity, *seed, seeds[i], -1.0f, settings);
+      std::reverse(path.points.begin(), path.points.end());
+      std::reverse(path.speeds.begin(), path.speeds.end());
+      const std::size_t skip = path.points.empty() ? 0 : 1;
+      if (forward.points.size() > skip)
+      {
+        path.points.insert(path.points.end(),
+                           forward.points.begin() + skip,
+                           forward.points.end());
+        path.speeds.insert(path.speeds.end(),
+                           forward.speeds.begin() + skip,
+                           forward.speeds.end());
+      }
+      path.nSteps += forward.nSteps;
+    });
+
+  float min = std::numeric_limits<float>::max();
+  float max = std::numeric_limits<float>::lowest();
+  for (const auto& path : paths)
+  {
+    if (path.points.size() < 2)
+    {
+      continue;
+    }
+    result.nPoints += path.points.size();
+    result.nSteps += path.nSteps;
+    for (const auto s : path.speeds)
+    {
+      min = std::min(s, min);
+      max = std::max(s, max);
+    }
+  }
+
+  result.vertices.reserve(lineBuffer::floats_per_vertex * result.nPoints);
+  for (const auto& path : paths)
+  {
+    if (path.points.size() < 2)
+    {
+      continue;
+    }
+
+    result.first.push_back(
+      GLint(result.vertices.size() / lineBuffer::floats_per_vertex));
+    result.counts.push_back(GLsizei(path.points.size()));
+    for (std::size_t i = 0; i < path.points.size(); ++i)
+    {
+      const auto& p = path.points[i];
+      const auto color = colormap(path.speeds[i], min, max);
+      result.vertices.insert(result.vertices.end(),
+                             { p.x, p.y, p.z, color.x, color.y, color.z });
+    }
+  }
+
+  result.seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  return result;
+}
+
+/// first field triple named <prefix>X, <prefix>Y and <prefix>Z of the zone,
+/// preferring velocity components
+inline std::optional<std::array<std::string, 3>>
+guess_velocity(const structuredZone& zone)
+{
+  std::optional<std::array<std::string, 3>> guess;
+  for (const auto& field : zone.fields)
+  {
+    const auto& name = field.name;
+    if (name.empty() || name.back() != 'X')
+    {
+      continue;
+    }
+
+    const auto prefix = name.substr(0, name.size() - 1);
+    std::array<std::string, 3> names{ name, prefix + "Y", prefix + "Z" };
+    if (!zone.field(names[1]) || !zone.field(names[2]))
+    {
+      continue;
+    }
+    if (prefix == "Velocity")
+    {
+      return names;
+    }
+    if (!guess)
+    {
+      guess = std::move(names);
+    }
+  }
+  return guess;
+}
+
+/// streamlines traced on the thread pool, shown once finished
+struct streamlineTool
+{
+  streamlineSettings settings;
+  bool enabled = false;
+
+  /// call once per frame on the GL thread
+  void update(std::shared_ptr<const std::vector<structuredZone>> zones)
+  {
+    if (zones != _zones)
+    {
+      _zones = std::move(zones);
+      _buffer.reset();
+      _shown.reset();
+
+      // seeds are kept for updated zones of the same data
+      if (_zones && !_zones->empty() &&
+          !_zones->front().field(settings.velocity[0]))
+      {
+        reset_seeds();
+      }
+    }
+
+    if (_pending.valid() && _pending.wait_for(std::chrono::seconds(0)) ==
+                              std::future_status::ready)
+    {
+      auto result = _pending.get();
+
+      // results computed for previous zones are dropped
+      if (_pendingZones != _zones)
+      {
+        _pendingZones.reset();
+        return;
+      }
+      _pendingZones.reset();
+
+      _shown = result.settings;
+      _stats = { result.n_lines(),
+                 result.nSeeds,
+                 result.nPoints,
+                 result.nSteps,
+                 result.seconds,
+                 result.lines_per_second() };
+
+      const trace::scope traceScope{ "upload streamlines", "upload" };
+      _buffer = lineBuffer{ std::move(result.vertices),
+                            std::move(result.first),
+                            std::move(result.counts) };
+    }
+
+    if (!enabled || !_zones || _pending.valid() ||
+        settings.velocity[0].empty())
+    {
+      return;
+    }
+
+    if (_shown && *_shown == settings)
+    {
+      return;
+    }
+
+    _pendingZones = _zones;
+    _pending = default_pool().submit(
+      [zones = _zones, request = settings]
+      { return trace_streamlines(*zones, request); });
+  }
+
+  void render(const shader& shader)
+  {
+    if (enabled && _buffer)
+    {
+      _buffer->draw(shader);
+    }
+  }
+
+  /// statistics of the shown streamlines
+  struct stats
+  {
+    std::size_t nLines = 0;
+    std::size_t nSeeds = 0;
+    std::size_t nPoints = 0;
+    std::size_t nSteps = 0;
+    double seconds = 0.0;
+    double linesPerSecond = 0.0;
+  };
+
+  const stats& last_stats() const noexcept { return _stats; }
+
+  bool busy() const noexcept { return _pending.valid(); }
+
+private:
+  std::shared_ptr<const std::vector<structuredZone>> _zones;
+  std::shared_ptr<const std::vector<structuredZone>> _pendingZones;
+  std::future<streamlineResult> _pending;
+  std::optional<streamlineSettings> _shown;
+  std::optional<lineBuffer> _buffer;
+  stats _stats;
+
+  /// rake across the inflow side and plane through the center of the data
+  void reset_seeds()
+  {
+    aabb bounds;
+    for (const auto& zone : *_zones)
+    {
+      bounds.extend(zone.bounds);
+    }
+    if (!bounds.valid())
+    {
+      return;
+    }
+
+    const glm::vec3 extent = bounds.max - bounds.min;
+    const glm::vec3 center = bounds.center();
+    settings.start = { bounds.min.x + 0.05f * extent.x,
+                       bounds.min.y + 0.05f * extent.y,
+                       center.z };
+    settings.end = { bounds.min.x + 0.05f * extent.x,
+                     bounds.max.y - 0.05f * extent.y,
+                     center.z };
+    settings.seedPlane = { center, { 1.0f, 0.0f, 0.0f } };
+    settings.size = 0.5f * std::max({ extent.x, extent.y, extent.z });
+
+    if (!_zones->empty())
+    {
+      if (auto names = guess_velocity(_zones->front()))
+      {
+        settings.velocity = std::move(*names);
+      }
+    }
+  }
+};
+
+} // namespace cgns_tools::gui
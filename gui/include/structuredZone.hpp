@@ -0,0 +1,666 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "compressedArray.hpp"
+#include "memory.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cgns-tools.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// axis aligned bounding box
+struct aabb
+{
+  glm::vec3 min{ std::numeric_limits<float>::max() };
+  glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+  void extend(const glm::vec3& p)
+  {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  void extend(const aabb& other)
+  {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+
+  bool valid() const { return min.x <= max.x; }
+
+  glm::vec3 center() const { return 0.5f * (min + max); }
+
+  glm::vec3 half_extent() const { return 0.5f * (max - min); }
+};
+
+/// immutable array of a zone, shared with the zones derived from it, e.g.
+/// the zones with quality fields, instead of copied
+///
+/// The values are accounted to memory::category::zones once and released
+/// with the last zone holding them.
+template<typename T>
+struct sharedArray
+{
+  sharedArray() = default;
+
+  sharedArray(std::vector<T> values)
+    : _storage{ std::make_shared<const storage>(std::move(values)) }
+  {
+  }
+
+  const std::vector<T>& vector() const noexcept
+  {
+    static const std::vector<T> empty{};
+    return _storage ? _storage->values : empty;
+  }
+
+  operator const std::vector<T>&() const noexcept { return vector(); }
+
+  const T& operator[](const std::size_t i) const { return _storage->values[i]; }
+
+  const T* data() const noexcept { return vector().data(); }
+
+  std::size_t size() const noexcept { return vector().size(); }
+
+  bool empty() const noexcept { return vector().empty(); }
+
+  auto begin() const noexcept { return vector().begin(); }
+
+  auto end() const noexcept { return vector().end(); }
+
+  /// bytes of the values, see memory::bytes
+  std::size_t size_bytes() const noexcept { return memory::bytes(vector()); }
+
+private:
+  struct storage
+  {
+    explicit storage(std::vector<T> values_)
+      : values{ std::move(values_) }
+      , usage{ memory::category::zones, memory::bytes(values) }
+    {
+    }
+
+    std::vector<T> values;
+    memory::allocation usage;
+  };
+
+  std::shared_ptr<const storage> _storage;
+};
+
+/// vertex located scalar field of a structured zone
+struct scalarField
+{
+  std::string name;
+  sharedArray<float> values;
+  float min = std::numeric_limits<float>::max();
+  float max = std::numeric_limits<float>::lowest();
+
+  /// hash of the file array, 0 for fields derived in the viewer
+  uint64_t hash = 0;
+
+  /// value range per brick of the zone
+  std::vector<float> brickMin;
+  std::vector<float> brickMax;
+
+  /// values held in compressed blocks, values is then empty, see
+  /// compress_fields and fieldValues
+  std::shared_ptr<const compressedArray> compressed;
+};
+
+/// values of a field for an extraction, compressed fields are decoded on
+/// construction
+struct fieldValues
+{
+  explicit fieldValues(const scalarField& field)
+    : _decoded{ field.compressed ? field.compressed->decode()
+                                 : std::vector<float>{} }
+    , _values{ field.compressed ? _decoded.data() : field.values.data() }
+  {
+  }
+
+  fieldValues(fieldValues&& other) noexcept = default;
+  fieldValues(const fieldValues& other) = delete;
+  fieldValues& operator=(const fieldValues& other) = delete;
+
+  float operator[](const std::size_t i) const { return _values[i]; }
+
+private:
+  std::vector<float> _decoded;
+  const float* _values;
+};
+
+struct zoneQuality;
+
+/// block of cells of a structured zone, the unit of work of the parallel
+/// extraction algorithms
+struct brick
+{
+  std::array<std::size_t, 3> begin; ///< first cell
+  std::array<std::size_t, 3> end;   ///< one past the last cell
+  aabb bounds;
+};
+
+/// structured zone converted to single precision and split into bricks
+struct structuredZone
+{
+  /// cells per brick and direction
+  static constexpr std::size_t brick_size = 16;
+
+  std::string name;
+  std::array<std::size_t, 3> dims; ///< vertices per direction
+  sharedArray<glm::vec3> points;
+  /// hash of the coordinate arrays of the file, see coordinates_hash
+  uint64_t pointsHash = 0;
+  std::vector<scalarField> fields;
+  std::vector<brick> bricks;
+  aabb bounds;
+
+  /// uploaded vertex n is point order[n], empty for i-j-k order, see
+  /// spatial_order
+  sharedArray<uint32_t> order;
+
+  /// cell quality metrics, if computed, see compute_zone_quality
+  std::shared_ptr<const zoneQuality> quality;
+
+  /// accounts the zone to memory::category::zones, see account_memory
+  memory::allocation usage;
+
+  std::size_t index(const std::size_t i,
+                    const std::size_t j,
+                    const std::size_t k) const
+  {
+    return i + dims[0] * (j + dims[1] * k);
+  }
+
+  std::size_t n_points() const { return dims[0] * dims[1] * dims[2]; }
+
+  std::size_t n_cells() const
+  {
+    std::size_t n = 1;
+    for (const auto d : dims)
+    {
+      n *= d > 1 ? d - 1 : 0;
+    }
+    return n;
+  }
+
+  /// bytes of points, fields, bricks and order, including the arrays shared
+  /// with other zones
+  std::size_t size_bytes() const
+  {
+    std::size_t n = points.size_bytes() + order.size_bytes();
+    for (const auto& f : fields)
+    {
+      n += f.values.size_bytes() +
+           (f.compressed ? f.compressed->compressed_bytes() : 0);
+    }
+    return n + owned_bytes();
+  }
+
+  /// bytes of the bricks and brick ranges, the only arrays not shared by
+  /// copy_zone
+  std::size_t owned_bytes() const
+  {
+    std::size_t n = memory::bytes(bricks);
+    for (const auto& f : fields)
+    {
+      n += memory::bytes(f.brickMin) + memory::bytes(f.brickMax);
+    }
+    return n;
+  }
+
+  /// update the accounted memory after the zone was built or changed, the
+  /// shared arrays account for themselves
+  void account_memory() { usage.reset(memory::category::zones, owned_bytes()); }
+
+  const scalarField* field(const std::string& fieldName) const
+  {
+    const auto it =
+      std::find_if(fields.begin(),
+                   fields.end(),
+                   [&](const auto& f) { return f.name == fieldName; });
+    return it != fields.end() ? &(*it) : nullptr;
+  }
+};
+
+/// call f(i, value) in parallel for all values of a cgns data array, the
+/// values are converted to float
+template<typename F>
+void
+for_each_value(const auto& dataArrayVariant, F&& f)
+{
+  constexpr std::size_t grain = 1 << 16;
+
+  std::visit(
+    [&](const auto& dataArray)
+    {
+      parallel_for(0,
+                   dataArray.data.size(),
+                   grain,
+                   [&](const std::size_t i)
+                   { f(i, static_cast<float>(dataArray.data[i])); });
+    },
+    dataArrayVariant);
+}
+
+/// number of values of a cgns data array
+inline std::size_t
+array_size(const auto& dataArrayVariant)
+{
+  return std::visit([](const auto& dataArray) { return dataArray.data.size(); },
+                    dataArrayVariant);
+}
+
+/// bytes of a cgns data array
+inline std::size_t
+array_bytes(const auto& dataArrayVariant)
+{
+  return std::visit([](const auto& dataArray)
+                    { return memory::bytes(dataArray.data); },
+                    dataArrayVariant);
+}
+
+/// bytes of the coordinate and solution arrays of a cgns zone
+inline std::size_t
+tree_bytes(const zoneStructured& zone)
+{
+  std::size_t n = 0;
+  for (const auto& gridCoordinates : zone.gridCoordinates)
+  {
+    for (const auto& dataArray : gridCoordinates.dataArrays)
+    {
+      n += array_bytes(dataArray);
+    }
+  }
+  for (const auto& flowSolution : zone.flowSolutions)
+  {
+    for (const auto& dataArray : flowSolution.dataArrays)
+    {
+      n += array_bytes(dataArray);
+    }
+  }
+  return n;
+}
+
+/// free a cgns data array, the tree keeps its name
+inline void
+release_array(auto& dataArrayVariant)
+{
+  std::visit([](auto& dataArray)
+             { dataArray.data = std::decay_t<decltype(dataArray.data)>{}; },
+             dataArrayVariant);
+}
+
+/// free the coordinate arrays of a cgns zone once its points are converted,
+/// the tree keeps their names
+inline void
+release_coordinates(zoneStructured& zone)
+{
+  for (auto& gridCoordinates : zone.gridCoordinates)
+  {
+    for (auto& dataArray : gridCoordinates.dataArrays)
+    {
+      release_array(dataArray);
+    }
+  }
+}
+
+/// free the coordinate and solution arrays of a cgns zone, the tree keeps
+/// their names
+inline void
+release_arrays(zoneStructured& zone)
+{
+  release_coordinates(zone);
+  for (auto& flowSolution : zone.flowSolutions)
+  {
+    for (auto& dataArray : flowSolution.dataArrays)
+    {
+      release_array(dataArray);
+    }
+  }
+}
+
+/// hash of a block of memory, in parallel over chunks of 1 MB
+///
+/// Not cryptographic, only meant to detect arrays rewritten with different
+/// values.
+inline uint64_t
+hash_bytes(const void* data, const std::size_t size)
+{
+  constexpr std::size_t chunk = std::size_t(1) << 20;
+  constexpr uint64_t multiplier = 0xff51afd7ed558ccdull;
+
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  std::vector<uint64_t> hashes((size + chunk - 1) / chunk);
+
+  parallel_for(0,
+               hashes.size(),
+               1,
+               [&](const std::size_t iChunk)
+               {
+                 const auto* p = bytes + iChunk * chunk;
+                 const std::size_t n = std::min(chunk, size - iChunk * chunk);
+
+                 uint64_t h = 0x9e3779b97f4a7c15ull ^ n;
+                 std::size_t i = 0;
+                 for (; i + 8 <= n; i += 8)
+                 {
+                   uint64_t word;
+                   std::memcpy(&word, p + i, 8);
+                   h = (h ^ word) * multiplier;
+                   h ^= h >> 29;
+                 }
+                 for (; i < n; ++i)
+                 {
+                   h = (h ^ p[i]) * multiplier;
+                 }
+                 hashes[iChunk] = h;
+               });
+
+  uint64_t h = size;
+  for (const auto c : hashes)
+  {
+    h = (h ^ c) * multiplier;
+    h ^= h >> 29;
+  }
+  // 0 is reserved for fields without a file array
+  return h != 0 ? h : 1;
+}
+
+/// hash of the values of a cgns data array
+inline uint64_t
+array_hash(const auto& dataArrayVariant)
+{
+  return std::visit(
+    [](const auto& dataArray)
+    {
+      return hash_bytes(dataArray.data.data(),
+                        dataArray.data.size() * sizeof(dataArray.data[0]));
+    },
+    dataArrayVariant);
+}
+
+/// hash of the coordinate arrays of a cgns zone, before they are released
+inline uint64_t
+coordinates_hash(const zoneStructured& zone)
+{
+  uint64_t h = 0;
+  for (const auto& dataArray : zone.gridCoordinates[0].dataArrays)
+  {
+    h = (h ^ array_hash(dataArray)) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+/// name of a cgns data array
+inline std::string
+array_name(const auto& dataArrayVariant)
+{
+  return std::visit([](const auto& dataArray) { return dataArray.name; },
+                    dataArrayVariant);
+}
+
+/// split the cells of the zone into bricks and compute their bounds
+inline void
+build_bricks(structuredZone& zone)
+{
+  std::array<std::size_t, 3> nCells;
+  std::array<std::size_t, 3> nBricks;
+  for (std::size_t d = 0; d < 3; ++d)
+  {
+    nCells[d] = zone.dims[d] > 1 ? zone.dims[d] - 1 : 0;
+    nBricks[d] = (nCells[d] + structuredZone::brick_size - 1) /
+                 structuredZone::brick_size;
+  }
+
+  zone.bricks.clear();
+  zone.bricks.resize(nBricks[0] * nBricks[1] * nBricks[2]);
+
+  parallel_for(
+    0,
+    zone.bricks.size(),
+    1,
+    [&](const std::size_t iBrick)
+    {
+      const std::array<std::size_t, 3> b{ iBrick % nBricks[0],
+                                           (iBrick / nBricks[0]) % nBricks[1],
+                                           iBrick / (nBricks[0] * nBricks[1]) };
+
+      auto& brick = zone.bricks[iBrick];
+      for (std::size_t d = 0; d < 3; ++d)
+      {
+        brick.begin[d] = b[d] * structuredZone::brick_size;
+        brick.end[d] =
+          std::min(brick.begin[d] + structuredZone::brick_size, nCells[d]);
+      }
+
+      // the cells of the brick span its points up to and including end
+      for (std::size_t k = brick.begin[2]; k <= brick.end[2]; ++k)
+      {
+        for (std::size_t j = brick.begin[1]; j <= brick.end[1]; ++j)
+        {
+          for (std::size_t i = brick.begin[0]; i <= brick.end[0]; ++i)
+          {
+            brick.bounds.extend(zone.points[zone.index(i, j, k)]);
+          }
+        }
+      }
+    });
+
+  zone.bounds = aabb{};
+  for (const auto& brick : zone.bricks)
+  {
+    zone.bounds.extend(brick.bounds);
+  }
+}
+
+/// compute the value range of a field of the zone per brick, the field must
+/// not be compressed yet
+inline void
+build_brick_ranges(const structuredZone& zone, scalarField& field)
+{
+  field.brickMin.assign(zone.bricks.size(), std::numeric_limits<float>::max());
+  field.brickMax.assign(zone.bricks.size(),
+                        std::numeric_limits<float>::lowest());
+
+  parallel_for(
+    0,
+    zone.bricks.size(),
+    1,
+    [&](const std::size_t iBrick)
+    {
+      const auto& brick = zone.bricks[iBrick];
+      float& min = field.brickMin[iBrick];
+      float& max = field.brickMax[iBrick];
+      for (std::size_t k = brick.begin[2]; k <= brick.end[2]; ++k)
+      {
+        for (std::size_t j = brick.begin[1]; j <= brick.end[1]; ++j)
+        {
+          for (std::size_t i = brick.begin[0]; i <= brick.end[0]; ++i)
+          {
+            const float v = field.values[zone.index(i, j, k)];
+            min = std::min(min, v);
+            max = std::max(max, v);
+          }
+        }
+      }
+    });
+}
+
+/// compute the value range of each field per brick
+inline void
+build_brick_ranges(structuredZone& zone)
+{
+  for (auto& field : zone.fields)
+  {
+    build_brick_ranges(zone, field);
+  }
+}
+
+/// compress the field values of a zone, with a tolerance relative to the
+/// value range of each field, see compressedArray
+inline void
+compress_fields(structuredZone& zone, const compressionSettings& settings)
+{
+  if (!settings.enabled)
+  {
+    return;
+  }
+
+  for (auto& field : zone.fields)
+  {
+    if (field.compressed)
+    {
+      continue;
+    }
+    const float maxError = settings.tolerance * (field.max - field.min);
+    field.compressed =
+      std::make_shared<const compressedArray>(field.values, maxError);
+    field.values = {};
+  }
+  zone.account_memory();
+}
+
+/// uncompressed and compressed bytes of the compressed fields of zones
+inline std::pair<std::size_t, std::size_t>
+compressed_bytes(const std::vector<structuredZone>& zones)
+{
+  std::size_t raw = 0;
+  std::size_t compressed = 0;
+  for (const auto& zone : zones)
+  {
+    for (const auto& field : zone.fields)
+    {
+      if (field.compressed)
+      {
+        raw += field.compressed->raw_bytes();
+        compressed += field.compressed->compressed_bytes();
+      }
+    }
+  }
+  return { raw, compressed };
+}
+
+/// copy of a zone sharing its points, order and field values, used to
+/// derive zones with additional fields while the original is still in use
+inline structuredZone
+copy_zone(const structuredZone& zone)
+{
+  structuredZone result;
+  result.name = zone.name;
+  result.dims = zone.dims;
+  result.points = zone.points;
+  result.pointsHash = zone.pointsHash;
+  result.fields = zone.fields;
+  result.bricks = zone.bricks;
+  result.bounds = zone.bounds;
+  result.order = zone.order;
+  result.quality = zone.quality;
+  result.account_memory();
+  return result;
+}
+
+/// vertex counts of a cgns structured zone
+inline std::array<std::size_t, 3>
+zone_dims(const zoneStructured& zone)
+{
+  // cgns zone size layout: vertex sizes first, followed by cell sizes
+  return { static_cast<std::size_t>(zone.size[0]),
+           static_cast<std::size_t>(zone.size[1]),
+           static_cast<std::size_t>(zone.size[2]) };
+}
+
+/// convert the coordinates of a cgns structured zone to float in parallel
+inline std::vector<glm::vec3>
+convert_points(const zoneStructured& zone, const std::size_t nPoints)
+{
+  const auto& gridCoordinates = zone.gridCoordinates[0];
+  assert(gridCoordinates.dataArrays.size() == 3);
+  assert(array_size(gridCoordinates.dataArrays[0]) == nPoints);
+
+  std::vector<glm::vec3> points(nPoints);
+  for (std::size_t d = 0; d < 3; ++d)
+  {
+    for_each_value(gridCoordinates.dataArrays[d],
+                   [&](const std::size_t i, const float x)
+                   { points[i][d] = x; });
+  }
+  return points;
+}
+
+/// convert a vertex located cgns data array to float in parallel, the brick
+/// ranges are left to build_brick_ranges
+inline scalarField
+convert_field(const auto& dataArray)
+{
+  scalarField field;
+  field.name = array_name(dataArray);
+  field.hash = array_hash(dataArray);
+  std::vector<float> values(array_size(dataArray));
+
+  for_each_value(dataArray,
+                 [&](const std::size_t i, const float x) { values[i] = x; });
+
+  const auto [min, max] = std::minmax_element(values.begin(), values.end());
+  field.min = *min;
+  field.max = *max;
+  field.values = std::move(values);
+  return field;
+}
+
+/// convert a cgns structured zone, coordinates and vertex located solution
+/// fields are converted to float in parallel, points already read from the
+/// file (see read_coordinates) are taken over instead of converting the
+/// coordinates of the tree
+inline structuredZone
+make_structured_zone(const zoneStructured& zone,
+                     std::vector<glm::vec3> points = {})
+{
+  structuredZone result;
+  result.name = zone.name;
+  result.dims = zone_dims(zone);
+
+  const std::size_t nPoints = result.n_points();
+  result.points = points.size() == nPoints ? std::move(points)
+                                           : convert_points(zone, nPoints);
+  result.pointsHash = coordinates_hash(zone);
+
+  for (const auto& flowSolution : zone.flowSolutions)
+  {
+    for (const auto& dataArray : flowSolution.dataArrays)
+    {
+      // only vertex located fields can be interpolated on the points
+      if (nPoints == 0 || array_size(dataArray) != nPoints)
+      {
+        continue;
+      }
+
+      result.fields.emplace_back(convert_field(dataArray));
+    }
+  }
+
+  build_bricks(result);
+  build_brick_ranges(result);
+  result.account_memory();
+
+  return result;
+}
+
+} // namespace cgns_tools::gui
@@ -0,0 +1,316 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// scoped performance events, exported as Chrome / Perfetto trace JSON
+///
+/// Every thread appends to its own buffer, recording an event involves no
+/// locks and no allocation except for a new chunk every chunk_size events.
+/// Event names must be string literals or otherwise outlive the process.
+namespace cgns_tools::gui::trace
+{
+
+/// one complete event, times in nanoseconds since the trace epoch
+struct event
+{
+  const char* name;
+  const char* category;
+  int64_t begin;
+  int64_t end;
+};
+
+namespace detail
+{
+
+using clock = std::chrono::steady_clock;
+
+inline const clock::time_point&
+epoch()
+{
+  static const auto start = clock::now();
+  return start;
+}
+
+/// single producer buffer, readable while the owning thread appends
+///
+/// Events are stored in a linked list of fixed size chunks. The writer
+/// publishes a chunk before the first event in it, and every event by
+/// incrementing the chunk counter, so readers never see partial events.
+struct threadBuffer
+{
+  static constexpr std::size_t chunk_size = 4096;
+
+  struct chunk
+  {
+    std::array<event, chunk_size> events;
+    std::atomic<std::size_t> count{ 0 };
+    std::atomic<chunk*> next{ nullptr };
+  };
+
+  explicit threadBuffer(const uint32_t id)
+    : id{ id }
+    , _head{ new chunk }
+    , _tail{ _head }
+  {
+  }
+
+  ~threadBuffer()
+  {
+    for (auto* c = _head; c;)
+    {
+      auto* next = c->next.load(std::memory_order_relaxed);
+      delete c;
+      c = next;
+    }
+  }
+
+  threadBuffer(const threadBuffer& other) = delete;
+  threadBuffer& operator=(const threadBuffer& other) = delete;
+
+  /// append an event, owning thread only
+  void push(const event& e)
+  {
+    auto count = _tail->count.load(std::memory_order_relaxed);
+    if (count == chunk_size)
+    {
+      auto* c = new chunk;
+      _tail->next.store(c, std::memory_order_release);
+      _tail = c;
+      count = 0;
+    }
+    _tail->events[count] = e;
+    _tail->count.store(count + 1, std::memory_order_release);
+  }
+
+  /// visit all published events, any thread
+  template<typename F>
+  void for_each(F&& f) const
+  {
+    for (const auto* c = _head; c; c = c->next.load(std::memory_order_acquire))
+    {
+      const auto count = c->count.load(std::memory_order_acquire);
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        f(c->events[i]);
+      }
+    }
+  }
+
+  const uint32_t id;
+  /// written under the registry mutex
+  std::string name;
+
+private:
+  chunk* _head;
+  chunk* _tail;
+};
+
+/// all thread buffers, buffers outlive their threads for export
+struct registry
+{
+  std::mutex mutex;
+  std::vector<std::unique_ptr<threadBuffer>> buffers;
+  std::atomic<bool> enabled{ false };
+  /// events starting before are not exported, see start
+  std::atomic<int64_t> since{ 0 };
+};
+
+inline registry&
+get_registry()
+{
+  static registry instance;
+  return instance;
+}
+
+/// buffer of the calling thread, registered on first use
+inline threadBuffer&
+local_buffer()
+{
+  thread_local threadBuffer* buffer = []
+  {
+    auto& r = get_registry();
+    std::lock_guard lock{ r.mutex };
+    const auto id = static_cast<uint32_t>(r.buffers.size());
+    return r.buffers.emplace_back(std::make_unique<threadBuffer>(id)).get();
+  }();
+  return *buffer;
+}
+
+inline int64_t
+now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                              epoch())
+    .count();
+}
+
+/// JSON string contents, names are expected to be plain text
+inline void
+write_escaped(std::FILE* file, const char* s)
+{
+  for (; *s; ++s)
+  {
+    if (*s == '"' || *s == '\\')
+    {
+      std::fputc('\\', file);
+    }
+    if (static_cast<unsigned char>(*s) >= 0x20)
+    {
+      std::fputc(*s, file);
+    }
+  }
+}
+
+} // namespace detail
+
+/// true while events are recorded
+inline bool
+enabled()
+{
+  return detail::get_registry().enabled.load(std::memory_order_relaxed);
+}
+
+/// start recording, events recorded earlier are dropped from the export
+inline void
+start()
+{
+  auto& r = detail::get_registry();
+  r.since.store(detail::now(), std::memory_order_relaxed);
+  r.enabled.store(true, std::memory_order_relaxed);
+}
+
+/// stop recording, recorded events are kept for the export
+inline void
+stop()
+{
+  detail::get_registry().enabled.store(false, std::memory_order_relaxed);
+}
+
+/// name of the calling thread in the exported trace
+inline void
+set_thread_name(std::string name)
+{
+  auto& buffer = detail::local_buffer();
+  std::lock_guard lock{ detail::get_registry().mutex };
+  buffer.name = std::move(name);
+}
+
+/// record an event spanning the lifetime of the object
+struct scope
+{
+  explicit scope(const char* name, const char* category = "gui")
+    : _name{ name }
+    , _category{ category }
+    , _begin{ enabled() ? detail::now() : -1 }
+  {
+  }
+
+  ~scope()
+  {
+    if (_begin >= 0)
+    {
+      detail::local_buffer().push({ _name, _category, _begin, detail::now() });
+    }
+  }
+
+  scope(const scope& other) = delete;
+  scope& operator=(const scope& other) = delete;
+
+private:
+  const char* _name;
+  const char* _category;
+  int64_t _begin;
+};
+
+/// number of events recorded since start
+inline std::size_t
+n_events()
+{
+  auto& r = detail::get_registry();
+  const auto since = r.since.load(std::memory_order_relaxed);
+
+  std::lock_guard lock{ r.mutex };
+  std::size_t n = 0;
+  for (const auto& buffer : r.buffers)
+  {
+    buffer->for_each([&](const event& e) { n += e.begin >= since; });
+  }
+  return n;
+}
+
+/// write the events recorded since start in the Chrome trace event format,
+/// readable by chrome://tracing and ui.perfetto.dev
+inline bool
+write_chrome_trace(const std::filesystem::path& path)
+{
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> file{
+    std::fopen(path.string().c_str(), "w"), &std::fclose
+  };
+  if (!file)
+  {
+    return false;
+  }
+
+  auto& r = detail::get_registry();
+  const auto since = r.since.load(std::memory_order_relaxed);
+
+  std::fputs("{\"traceEvents\":[\n", file.get());
+  bool first = true;
+  const auto separator = [&]
+  {
+    std::fputs(first ? "" : ",\n", file.get());
+    first = false;
+  };
+
+  std::lock_guard lock{ r.mutex };
+  for (const auto& buffer : r.buffers)
+  {
+    if (!buffer->name.empty())
+    {
+      separator();
+      std::fprintf(file.get(),
+                   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":%u,\"args\":{\"name\":\"",
+                   buffer->id);
+      detail::write_escaped(file.get(), buffer->name.c_str());
+      std::fputs("\"}}", file.get());
+    }
+
+    buffer->for_each(
+      [&](const event& e)
+      {
+        if (e.begin < since)
+        {
+          return;
+        }
+        separator();
+        std::fputs("{\"name\":\"", file.get());
+        detail::write_escaped(file.get(), e.name);
+        std::fputs("\",\"cat\":\"", file.get());
+        detail::write_escaped(file.get(), e.category);
+        std::fprintf(file.get(),
+                     "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                     "\"ts\":%.3f,\"dur\":%.3f}",
+                     buffer->id,
+                     1e-3 * e.begin,
+                     1e-3 * (e.end - e.begin));
+      });
+  }
+
+  std::fputs("\n]}\n", file.get());
+  return std::ferror(file.get()) == 0;
+}
+
+} // namespace cgns_tools::gui::trace
@@ -0,0 +1,103 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "coordinateReader.hpp"
+#include "parallel.hpp"
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include <cgns-tools.hpp>
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// read the tree of a CGNS file with cgns-tools
+inline root
+read_tree(const std::string& path)
+{
+  const std::lock_guard lock{ hdf5_mutex() };
+
+  std::optional<cgns_tools::fileIn> f;
+  {
+    const trace::scope openScope{ "open file", "io" };
+    f.emplace(path);
+  }
+
+  const trace::scope readScope{ "HDF5 read", "io" };
+  return f->readBaseInformation();
+}
+
+/// tree of a CGNS file with the points of its structured zones
+struct treeRead
+{
+  root tree;
+  /// points read directly from the file; nullopt if they are converted from
+  /// the coordinate arrays of the tree
+  std::optional<coordinateReadResult> coordinates;
+  /// array bytes read from the file, and the duration
+  std::size_t bytes = 0;
+  double seconds = 0.0;
+};
+
+/// read the tree of a CGNS file and, with readPoints, the points of its
+/// structured zones
+///
+/// cgns-tools reads the tree. For CGNS/HDF5 files with contiguous
+/// coordinate arrays read_coordinates reads and converts the points with
+/// parallel positional reads at the same time, so the conversion is done
+/// once the tree is. cgns-tools cannot skip the coordinate arrays, so they
+/// are read by both, the callers release them from the tree after
+/// conversion. Without readPoints, e.g. to compare the arrays by hash
+/// first, the points are left to the tree.
+inline treeRead
+read_file_tree(const std::string& path, const bool readPoints = true)
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  std::optional<std::future<std::optional<coordinateReadResult>>>
+    coordinateRead;
+  if (auto plans = readPoints ? plan_coordinate_reads(path) : std::nullopt)
+  {
+    coordinateRead = default_pool().submit(
+      [path, plans = std::move(*plans)]
+      { return read_coordinates(path, plans); });
+  }
+
+  treeRead result;
+  result.tree = read_tree(path);
+  if (coordinateRead)
+  {
+    result.coordinates = coordinateRead->get();
+  }
+
+  if (!result.tree.bases.empty())
+  {
+    for (const auto& zone : result.tree.bases[0].zones)
+    {
+      if (const auto* structured = std::get_if<zoneStructured>(&zone))
+      {
+        result.bytes += tree_bytes(*structured);
+      }
+    }
+  }
+  if (result.coordinates)
+  {
+    result.bytes += result.coordinates->bytes;
+  }
+
+  result.seconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+  return result;
+}
+
+} // namespace cgns_tools::gui
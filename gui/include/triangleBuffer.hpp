@@ -0,0 +1,146 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "helpers.hpp"
+#include "memory.hpp"
+#include "shader.hpp"
+#include <glad/glad.h>
+#include <utility>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// triangles with per vertex color, interleaved as x, y, z, r, g, b
+struct triangleBuffer
+{
+  static constexpr std::size_t floats_per_vertex = 6;
+
+  /// constructor
+  triangleBuffer(std::vector<float>&& vertices)
+    : _vertices{ std::move(vertices) }
+    , _vbo{}
+    , _vao{}
+    , _staging{ memory::category::staging, memory::bytes(_vertices) }
+    , _gpu{ memory::category::gl_buffers, sizeof(float) * _vertices.size() }
+  {
+    create_buffers();
+  }
+
+  /// destructor
+  ~triangleBuffer() { delete_buffers(); }
+
+  /// copy constructor
+  triangleBuffer(const triangleBuffer& other) = delete;
+
+  /// move constructor
+  triangleBuffer(triangleBuffer&& other) noexcept
+    : _vertices(std::move(other._vertices))
+    , _vbo{ other._vbo }
+    , _vao{ other._vao }
+    , _staging{ std::move(other._staging) }
+    , _gpu{ std::move(other._gpu) }
+  {
+    other._vbo = 0;
+    other._vao = 0;
+  }
+
+  /// copy assignment
+  triangleBuffer& operator=(const triangleBuffer& other) = delete;
+
+  /// move assignment
+  triangleBuffer& operator=(triangleBuffer&& other) noexcept
+  {
+    std::swap(_vertices, other._vertices);
+    std::swap(_vbo, other._vbo);
+    std::swap(_vao, other._vao);
+    std::swap(_staging, other._staging);
+    std::swap(_gpu, other._gpu);
+    return *this;
+  }
+
+  std::size_t n_triangles() const
+  {
+    return _vertices.size() / (3 * floats_per_vertex);
+  }
+
+  void draw(const shader& shader)
+  {
+    if (_vertices.empty())
+    {
+      return;
+    }
+
+    shader.use();
+
+    bind();
+
+    opengl_fn<glDrawArrays>(
+      GL_TRIANGLES, 0, _vertices.size() / floats_per_vertex);
+
+    unbind();
+  }
+
+private:
+  std::vector<float> _vertices;
+
+  GLuint _vbo;
+  GLuint _vao;
+
+  memory::allocation _staging;
+  memory::allocation _gpu;
+
+  void bind() { opengl_fn<glBindVertexArray>(_vao); }
+
+  void unbind() { opengl_fn<glBindVertexArray>(0); }
+
+  void create_buffers()
+  {
+    opengl_fn<glGenVertexArrays>(1, &_vao);
+    opengl_fn<glBindVertexArray>(_vao);
+
+    opengl_fn<glGenBuffers>(1, &_vbo);
+    opengl_fn<glBindBuffer>(GL_ARRAY_BUFFER, _vbo);
+    opengl_fn<glBufferData>(GL_ARRAY_BUFFER,
+                            sizeof(float) * _vertices.size(),
+                            _vertices.data(),
+                            GL_STATIC_DRAW);
+
+    // position
+    opengl_fn<glVertexAttribPointer>(0,
+                                     3,
+                                     GL_FLOAT,
+                                     GL_FALSE,
+                                     floats_per_vertex * sizeof(float),
+                                     (void*)0);
+    opengl_fn<glEnableVertexAttribArray>(0);
+
+    // color
+    opengl_fn<glVertexAttribPointer>(1,
+                                     3,
+                                     GL_FLOAT,
+                                     GL_FALSE,
+                                     floats_per_vertex * sizeof(float),
+                                     (void*)(3 * sizeof(float)));
+    opengl_fn<glEnableVertexAttribArray>(1);
+
+    unbind();
+  }
+
+  void delete_buffers()
+  {
+    if (_vbo)
+    {
+      opengl_fn<glDeleteBuffers>(1, &_vbo);
+    }
+
+    if (_vao)
+    {
+      opengl_fn<glDeleteVertexArrays>(1, &_vao);
+    }
+  }
+};
+
+} // namespace cgns_tools::gui
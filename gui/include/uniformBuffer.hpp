@@ -0,0 +1,64 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "helpers.hpp"
+#include <glad/glad.h>
+#include <type_traits>
+
+namespace cgns_tools::gui
+{
+
+/// uniform buffer holding a single std140 struct T, bound to a fixed binding
+/// point and shared by all programs using the corresponding uniform block
+template<typename T>
+struct uniformBuffer
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  /// constructor
+  explicit uniformBuffer(const GLuint binding)
+    : _ubo{ 0 }
+    , _binding{ binding }
+  {
+    opengl_fn<glGenBuffers>(1, &_ubo);
+    opengl_fn<glBindBuffer>(GL_UNIFORM_BUFFER, _ubo);
+    opengl_fn<glBufferData>(
+      GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+    opengl_fn<glBindBuffer>(GL_UNIFORM_BUFFER, 0);
+
+    opengl_fn<glBindBufferBase>(GL_UNIFORM_BUFFER, _binding, _ubo);
+  }
+
+  /// destructor
+  ~uniformBuffer()
+  {
+    if (_ubo)
+    {
+      opengl_fn<glDeleteBuffers>(1, &_ubo);
+    }
+  }
+
+  /// copy constructor
+  uniformBuffer(const uniformBuffer& other) = delete;
+
+  /// copy assignment
+  uniformBuffer& operator=(const uniformBuffer& other) = delete;
+
+  GLuint binding() const noexcept { return _binding; }
+
+  /// upload new contents, visible to all programs bound to the block
+  void update(const T& value)
+  {
+    opengl_fn<glBindBuffer>(GL_UNIFORM_BUFFER, _ubo);
+    opengl_fn<glBufferSubData>(GL_UNIFORM_BUFFER, 0, sizeof(T), &value);
+    opengl_fn<glBindBuffer>(GL_UNIFORM_BUFFER, 0);
+  }
+
+private:
+  GLuint _ubo;
+  GLuint _binding;
+};
+
+} // namespace cgns_tools::gui
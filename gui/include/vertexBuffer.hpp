@@ -4,8 +4,16 @@
 #pragma once
 
 #include "helpers.hpp"
+#include "memory.hpp"
 #include "shader.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <numeric>
+#include <span>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -13,6 +21,16 @@
 namespace cgns_tools::gui
 {
 
+/// structured zone stored in a vertexBuffer, see set_grid_zones
+struct gridZone
+{
+  std::size_t firstPoint;          ///< first point of the zone in the buffer
+  std::array<std::size_t, 3> dims; ///< points per direction
+  /// i-j-k point index of each uploaded point, empty for i-j-k order, see
+  /// structuredZone::order
+  std::span<const uint32_t> order;
+};
+
 struct vertexBuffer
 {
 
@@ -21,6 +39,12 @@ struct vertexBuffer
     : _vertices{ std::move(vertices) }
     , _vbo{}
     , _vao{}
+    , _texture{}
+    , _maxTexels{}
+    , _grid{}
+    , _staging{ memory::category::staging, memory::bytes(_vertices) }
+    , _gpu{ memory::category::gl_buffers, sizeof(float) * _vertices.size() }
+    , _rankGpu{}
   {
     create_buffers();
   }
@@ -36,9 +60,17 @@ struct vertexBuffer
     : _vertices(std::move(other._vertices))
     , _vbo{ other._vbo }
     , _vao{ other._vao }
+    , _texture{ other._texture }
+    , _maxTexels{ other._maxTexels }
+    , _grid{ std::move(other._grid) }
+    , _staging{ std::move(other._staging) }
+    , _gpu{ std::move(other._gpu) }
+    , _rankGpu{ std::move(other._rankGpu) }
   {
     other._vbo = 0;
     other._vao = 0;
+    other._texture = 0;
+    other._grid.clear();
   }
 
   /// copy assignment
@@ -50,9 +82,33 @@ struct vertexBuffer
     std::swap(_vertices, other._vertices);
     std::swap(_vbo, other._vbo);
     std::swap(_vao, other._vao);
+    std::swap(_texture, other._texture);
+    std::swap(_maxTexels, other._maxTexels);
+    std::swap(_grid, other._grid);
+    std::swap(_staging, other._staging);
+    std::swap(_gpu, other._gpu);
+    std::swap(_rankGpu, other._rankGpu);
     return *this;
   }
 
+  /// replace count values starting at offset, only this range is uploaded
+  void update(const std::size_t offset,
+              const float* values,
+              const std::size_t count)
+  {
+    std::copy(values, values + count, _vertices.begin() + offset);
+
+    opengl_fn<glBindBuffer>(GL_ARRAY_BUFFER, _vbo);
+    opengl_fn<glBufferSubData>(GL_ARRAY_BUFFER,
+                               sizeof(float) * offset,
+                               sizeof(float) * count,
+                               values);
+    opengl_fn<glBindBuffer>(GL_ARRAY_BUFFER, 0);
+  }
+
+  /// number of floats, three per point
+  std::size_t size() const noexcept { return _vertices.size(); }
+
   void draw(const shader& shader)
   {
     shader.use();
@@ -66,11 +122,194 @@ struct vertexBuffer
     unbind();
   }
 
+  /// draw count[n] points starting at first[n] for all n, e.g. prefixes of
+  /// spatially ordered zones
+  void draw(const shader& shader,
+            const std::vector<GLint>& first,
+            const std::vector<GLsizei>& counts)
+  {
+    shader.use();
+
+    bind();
+
+    opengl_fn<glPointSize>(2);
+    opengl_fn<glMultiDrawArrays>(
+      GL_POINTS, first.data(), counts.data(), GLsizei(counts.size()));
+
+    unbind();
+  }
+
+  /// prepare draw_grid_lines for structured zones stored back to back
+  ///
+  /// Each zone gets a buffer texture view of its own points, so the texel
+  /// limit of the driver applies per zone and not to the whole buffer.
+  /// Without glTexBufferRange (GL 4.3) all zones share one view of the
+  /// buffer. Spatially ordered zones also get the buffer position of each
+  /// point, the inverse of their order.
+  void set_grid_zones(const std::vector<gridZone>& zones)
+  {
+    delete_grid();
+    opengl_fn<glGetIntegerv>(GL_MAX_TEXTURE_BUFFER_SIZE, &_maxTexels);
+
+    constexpr std::size_t pointBytes = 3 * sizeof(float);
+    GLint alignment = 1;
+    if (glTexBufferRange)
+    {
+      opengl_fn<glGetIntegerv>(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    }
+    else
+    {
+      opengl_fn<glGenTextures>(1, &_texture);
+      opengl_fn<glBindTexture>(GL_TEXTURE_BUFFER, _texture);
+      opengl_fn<glTexBuffer>(GL_TEXTURE_BUFFER, GL_R32F, _vbo);
+    }
+    // views start at a multiple of the alignment and of a point
+    const std::size_t step =
+      std::lcm(std::size_t(std::max(alignment, 1)), pointBytes);
+
+    std::size_t rankBytes = 0;
+    std::vector<uint32_t> ranks;
+    for (const auto& zone : zones)
+    {
+      const std::size_t nPoints = zone.dims[0] * zone.dims[1] * zone.dims[2];
+
+      auto& grid = _grid.emplace_back();
+      grid.dims = zone.dims;
+      if (_texture)
+      {
+        grid.points = _texture;
+        grid.firstTexel = 3 * zone.firstPoint;
+        grid.fits = 3 * (zone.firstPoint + nPoints) <= std::size_t(_maxTexels);
+      }
+      else
+      {
+        const std::size_t begin = pointBytes * zone.firstPoint;
+        const std::size_t offset = begin / step * step;
+        grid.firstTexel = (begin - offset) / pointBytes;
+        grid.fits = grid.firstTexel + nPoints <= std::size_t(_maxTexels);
+        if (grid.fits)
+        {
+          opengl_fn<glGenTextures>(1, &grid.points);
+          opengl_fn<glBindTexture>(GL_TEXTURE_BUFFER, grid.points);
+          opengl_fn<glTexBufferRange>(GL_TEXTURE_BUFFER,
+                                      GL_RGB32F,
+                                      _vbo,
+                                      GLintptr(offset),
+                                      GLsizeiptr(begin - offset +
+                                                 pointBytes * nPoints));
+        }
+      }
+
+      if (!grid.fits || zone.order.empty())
+      {
+        continue;
+      }
+
+      ranks.resize(nPoints);
+      for (std::size_t n = 0; n < nPoints; ++n)
+      {
+        ranks[zone.order[n]] = uint32_t(n);
+      }
+
+      opengl_fn<glGenBuffers>(1, &grid.rankBuffer);
+      opengl_fn<glBindBuffer>(GL_TEXTURE_BUFFER, grid.rankBuffer);
+      opengl_fn<glBufferData>(GL_TEXTURE_BUFFER,
+                              sizeof(uint32_t) * ranks.size(),
+                              ranks.data(),
+                              GL_STATIC_DRAW);
+
+      opengl_fn<glGenTextures>(1, &grid.ranks);
+      opengl_fn<glBindTexture>(GL_TEXTURE_BUFFER, grid.ranks);
+      opengl_fn<glTexBuffer>(GL_TEXTURE_BUFFER, GL_R32UI, grid.rankBuffer);
+      rankBytes += sizeof(uint32_t) * ranks.size();
+    }
+
+    opengl_fn<glBindTexture>(GL_TEXTURE_BUFFER, 0);
+    opengl_fn<glBindBuffer>(GL_TEXTURE_BUFFER, 0);
+    _rankGpu.reset(memory::category::gl_buffers, rankBytes);
+  }
+
+  /// draw the grid lines of zone iZone of set_grid_zones, only every
+  /// stride-th line per direction and the last one
+  ///
+  /// The wire shader computes the segment end points from gl_VertexID and
+  /// fetches them from the buffer texture of the zone, no index buffer is
+  /// needed. Zones beyond the buffer texture size of the driver are skipped,
+  /// false in that case.
+  bool draw_grid_lines(const shader& shader,
+                       const std::size_t iZone,
+                       const std::size_t stride)
+  {
+    const auto& grid = _grid[iZone];
+    if (!grid.fits)
+    {
+      return false;
+    }
+
+    const auto& dims = grid.dims;
+    const std::size_t s = std::max<std::size_t>(stride, 1);
+    const auto n_lines = [s](const std::size_t n)
+    { return (n + s - 2) / s + 1; };
+
+    shader.use();
+    shader.set_i1(0, "points");
+    shader.set_i1(_texture == 0, "packed");
+    shader.set_i1(int(grid.firstTexel), "firstTexel");
+    shader.set_ivec3({ int(dims[0]), int(dims[1]), int(dims[2]) }, "dims");
+    shader.set_i1(int(s), "stride");
+    shader.set_i1(1, "ranks");
+    shader.set_i1(grid.ranks != 0, "reordered");
+
+    bind();
+    opengl_fn<glActiveTexture>(GL_TEXTURE1);
+    opengl_fn<glBindTexture>(GL_TEXTURE_BUFFER, grid.ranks);
+    opengl_fn<glActiveTexture>(GL_TEXTURE0);
+    opengl_fn<glBindTexture>(GL_TEXTURE_BUFFER, grid.points);
+
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+      if (dims[d] < 2)
+      {
+        continue;
+      }
+      const std::size_t nSegments = (dims[d] - 1) *
+                                    n_lines(dims[(d + 1) % 3]) *
+                                    n_lines(dims[(d + 2) % 3]);
+      shader.set_i1(int(d), "direction");
+      opengl_fn<glDrawArrays>(GL_LINES, 0, GLsizei(2 * nSegments));
+    }
+
+    opengl_fn<glBindTexture>(GL_TEXTURE_BUFFER, 0);
+    opengl_fn<glActiveTexture>(GL_TEXTURE1);
+    opengl_fn<glBindTexture>(GL_TEXTURE_BUFFER, 0);
+    opengl_fn<glActiveTexture>(GL_TEXTURE0);
+    unbind();
+    return true;
+  }
+
 private:
   std::vector<float> _vertices;
 
   GLuint _vbo;
   GLuint _vao;
+  GLuint _texture; ///< view of the whole buffer without glTexBufferRange
+  GLint _maxTexels;
+
+  /// buffer textures of a zone for draw_grid_lines
+  struct gridTextures
+  {
+    std::array<std::size_t, 3> dims{};
+    GLuint points = 0;          ///< view of the zone, or _texture
+    std::size_t firstTexel = 0; ///< of the first point of the zone in points
+    GLuint rankBuffer = 0;
+    GLuint ranks = 0; ///< buffer position of each point, ordered zones only
+    bool fits = false;
+  };
+  std::vector<gridTextures> _grid;
+
+  memory::allocation _staging;
+  memory::allocation _gpu;
+  memory::allocation _rankGpu;
   //   GLuint _IBO;
 
   void bind() { opengl_fn<glBindVertexArray>(_vao); }
@@ -94,8 +333,37 @@ private:
     opengl_fn<glEnableVertexAttribArray>(0);
   }
 
+  void delete_grid()
+  {
+    for (auto& grid : _grid)
+    {
+      if (grid.points && grid.points != _texture)
+      {
+        opengl_fn<glDeleteTextures>(1, &grid.points);
+      }
+      if (grid.ranks)
+      {
+        opengl_fn<glDeleteTextures>(1, &grid.ranks);
+      }
+      if (grid.rankBuffer)
+      {
+        opengl_fn<glDeleteBuffers>(1, &grid.rankBuffer);
+      }
+    }
+    _grid.clear();
+
+    if (_texture)
+    {
+      opengl_fn<glDeleteTextures>(1, &_texture);
+      _texture = 0;
+    }
+    _rankGpu.reset(0);
+  }
+
   void delete_buffers()
   {
+    delete_grid();
+
     if (_vbo)
     {
       opengl_fn<glDeleteBuffers>(1, &_vbo);
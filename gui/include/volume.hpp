@@ -0,0 +1,465 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "cellLocator.hpp"
+#include "colormap.hpp"
+#include "parallel.hpp"
+#include "shader.hpp"
+#include "structuredZone.hpp"
+#include "trace.hpp"
+#include "volumeTexture.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <future>
+#include <glm/glm.hpp>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// parameters of a volume resampling
+struct volumeSettings
+{
+  std::string field;
+  /// samples along the longest side of the bounds
+  std::size_t resolution = 128;
+
+  bool operator==(const volumeSettings& other) const = default;
+};
+
+/// control point of a transfer function over the normalized field value
+struct transferPoint
+{
+  float value = 0.0f;
+  glm::vec3 color{ 1.0f };
+  float opacity = 0.0f;
+
+  bool operator==(const transferPoint& other) const = default;
+};
+
+/// color and opacity over the normalized field value, linear between the
+/// points
+struct transferFunction
+{
+  std::vector<transferPoint> points;
+
+  /// the colormap with opacity rising towards high values
+  static transferFunction ramp()
+  {
+    transferFunction result;
+    constexpr std::array<float, 5> opacities{ 0.0f, 0.02f, 0.1f, 0.3f, 0.6f };
+    for (std::size_t i = 0; i < opacities.size(); ++i)
+    {
+      const float t = float(i) / float(opacities.size() - 1);
+      result.points.push_back({ t, colormap(t), opacities[i] });
+    }
+    return result;
+  }
+
+  /// n rgba entries from value 0 to 1, points are taken in value order
+  std::vector<float> table(const std::size_t n) const
+  {
+    auto sorted = points;
+    std::stable_sort(sorted.begin(),
+                     sorted.end(),
+                     [](const transferPoint& a, const transferPoint& b)
+                     { return a.value < b.value; });
+
+    std::vector<float> rgba(4 * n, 0.0f);
+    if (sorted.empty())
+    {
+      return rgba;
+    }
+
+    std::size_t p = 0;
+    for (std::size_t e = 0; e < n; ++e)
+    {
+      const float t = n > 1 ? float(e) / float(n - 1) : 0.0f;
+      while (p < sorted.size() && sorted[p].value < t)
+      {
+        ++p;
+      }
+
+      // constant beyond the first and last point
+      const auto& a = sorted[p > 0 ? p - 1 : 0];
+      const auto& b = sorted[std::min(p, sorted.size() - 1)];
+      const float w =
+        b.value > a.value ? std::clamp((t - a.value) / (b.value - a.value),
+                                       0.0f,
+                                       1.0f)
+                          : 1.0f;
+      const glm::vec3 color = a.color + w * (b.color - a.color);
+      rgba[4 * e] = color.x;
+      rgba[4 * e + 1] = color.y;
+      rgba[4 * e + 2] = color.z;
+      rgba[4 * e + 3] = a.opacity + w * (b.opacity - a.opacity);
+    }
+    return rgba;
+  }
+
+  /// point halfway in the widest gap between the points
+  void add_point()
+  {
+    auto sorted = points;
+    std::sort(sorted.begin(),
+              sorted.end(),
+              [](const transferPoint& a, const transferPoint& b)
+              { return a.value < b.value; });
+
+    float value = 0.5f;
+    float gap = 0.0f;
+    for (std::size_t i = 0; i + 1 < sorted.size(); ++i)
+    {
+      if (sorted[i + 1].value - sorted[i].value > gap)
+      {
+        gap = sorted[i + 1].value - sorted[i].value;
+        value = 0.5f * (sorted[i].value + sorted[i + 1].value);
+      }
+    }
+
+    const auto rgba = table(volumeTexture::transfer_size);
+    const auto e =
+      std::size_t(value * float(volumeTexture::transfer_size - 1) + 0.5f);
+    points.push_back(
+      { value,
+        glm::vec3{ rgba[4 * e], rgba[4 * e + 1], rgba[4 * e + 2] },
+        rgba[4 * e + 3] });
+  }
+
+  bool operator==(const transferFunction& other) const = default;
+};
+
+/// scalar field sampled on a regular grid over the bounds of the zones
+struct volumeResult
+{
+  volumeSettings settings;
+  std::array<std::size_t, 3> dims{};
+  aabb bounds;
+  /// x fastest, normalized to [0, 1] by the field range, -1 outside
+  std::vector<float> values;
+  float min = 0.0f;
+  float max = 0.0f;
+  std::size_t nInside = 0;
+  double seconds = 0.0;
+
+  std::size_t n_samples() const { return values.size(); }
+
+  double samples_per_second() const
+  {
+    return seconds > 0.0 ? n_samples() / seconds : 0.0;
+  }
+};
+
+namespace detail
+{
+
+/// trilinear interpolation of a field at a located point
+inline float
+interpolate(const structuredZone& zone,
+            const fieldValues& values,
+            const cellPosition& position)
+{
+  const glm::vec3 x = position.local;
+  const glm::vec3 m = 1.0f - x;
+  float result = 0.0f;
+  for (std::size_t k = 0; k < 8; ++k)
+  {
+    const std::size_t i = position.cell[0] + (k & 1);
+    const std::size_t j = position.cell[1] + ((k >> 1) & 1);
+    const std::size_t l = position.cell[2] + (k >> 2);
+    const float w = ((k & 1) ? x.x : m.x) * (((k >> 1) & 1) ? x.y : m.y) *
+                    ((k >> 2) ? x.z : m.z);
+    result += w * values[zone.index(i, j, l)];
+  }
+  return result;
+}
+
+/// position moved by step cells, clamped to the cells of the zone
+inline cellPosition
+advance(const std::vector<structuredZone>& zones,
+        cellPosition position,
+        const std::array<std::ptrdiff_t, 3>& step)
+{
+  const auto& zone = zones[position.zone];
+  for (std::size_t d = 0; d < 3; ++d)
+  {
+    position.cell[d] = std::size_t(
+      std::clamp<std::ptrdiff_t>(std::ptrdiff_t(position.cell[d]) + step[d],
+                                 0,
+                                 std::ptrdiff_t(zone.dims[d]) - 2));
+  }
+  return position;
+}
+
+/// samples per direction for the longest side of the bounds at resolution
+inline std::array<std::size_t, 3>
+volume_dims(const aabb& bounds, const std::size_t resolution)
+{
+  const glm::vec3 extent = glm::max(bounds.max - bounds.min, 1e-30f);
+  const float longest = std::max({ extent.x, extent.y, extent.z });
+  const std::size_t n = std::max<std::size_t>(resolution, 2);
+
+  std::array<std::size_t, 3> dims;
+  for (std::size_t d = 0; d < 3; ++d)
+  {
+    dims[d] = std::clamp<std::size_t>(
+      std::size_t(std::lround(float(n) * extent[d] / longest)), 2, n);
+  }
+  return dims;
+}
+
+} // namespace detail
+
+/// sample a field of the zones on a regular grid over their bounds
+///
+/// Slices of the grid are sampled in parallel. Each sample is located by a
+/// walk from the cell of the previous sample in the row, advanced by the
+/// last step between cells, so most samples take a single step. Samples the
+/// walk does not reach are found with the brick grid of a cellLocator.
+inline volumeResult
+resample_volume(const std::vector<structuredZone>& zones,
+                const volumeSettings& settings)
+{
+  const trace::scope traceScope{ "resample volume", "volume" };
+  const auto start = std::chrono::steady_clock::now();
+
+  volumeResult result;
+  result.settings = settings;
+
+  std::vector<std::optional<fieldValues>> zoneValues(zones.size());
+  float min = std::numeric_limits<float>::max();
+  float max = std::numeric_limits<float>::lowest();
+  for (std::size_t z = 0; z < zones.size(); ++z)
+  {
+    result.bounds.extend(zones[z].bounds);
+    if (const auto* field = zones[z].field(settings.field))
+    {
+      zoneValues[z].emplace(*field);
+      min = std::min(min, field->min);
+      max = std::max(max, field->max);
+    }
+  }
+  if (!result.bounds.valid() || min > max)
+  {
+    return result;
+  }
+  result.min = min;
+  result.max = max;
+
+  const auto dims = detail::volume_dims(result.bounds, settings.resolution);
+  result.dims = dims;
+  result.values.assign(dims[0] * dims[1] * dims[2], -1.0f);
+
+  const cellLocator locator{ zones };
+  const glm::vec3 spacing =
+    (result.bounds.max - result.bounds.min) /
+    glm::vec3{ float(dims[0] - 1), float(dims[1] - 1), float(dims[2] - 1) };
+  const float scale = max > min ? 1.0f / (max - min) : 0.0f;
+
+  std::vector<std::size_t> inside(dims[2], 0);
+  parallel_for(
+    0,
+    dims[2],
+    1,
+    [&](const std::size_t k)
+    {
+      // first located sample of the previous row
+      std::optional<cellPosition> rowHint;
+      for (std::size_t j = 0; j < dims[1]; ++j)
+      {
+        std::optional<cellPosition> hint = rowHint;
+        rowHint.reset();
+        std::array<std::ptrdiff_t, 3> step{};
+        for (std::size_t i = 0; i < dims[0]; ++i)
+        {
+          // the last sample lies on the bounds despite rounding
+          const glm::vec3 p = glm::min(
+            result.bounds.min +
+              spacing * glm::vec3{ float(i), float(j), float(k) },
+            result.bounds.max);
+          const auto position =
+            hint ? locator.locate(p, detail::advance(zones, *hint, step))
+                 : locator.locate(p);
+          if (!position)
+          {
+            continue;
+          }
+
+          // samples are evenly spaced, the cells of a row nearly so
+          step = {};
+          if (hint && hint->zone == position->zone)
+          {
+            for (std::size_t d = 0; d < 3; ++d)
+            {
+              step[d] = std::ptrdiff_t(position->cell[d]) -
+                        std::ptrdiff_t(hint->cell[d]);
+            }
+          }
+          hint = position;
+          if (!rowHint)
+          {
+            rowHint = position;
+          }
+
+          const auto& values = zoneValues[position->zone];
+          if (!values)
+          {
+            continue;
+          }
+          const float v =
+            detail::interpolate(zones[position->zone], *values, *position);
+          result.values[i + dims[0] * (j + dims[1] * k)] =
+            std::clamp((v - min) * scale, 0.0f, 1.0f);
+          ++inside[k];
+        }
+      }
+    });
+
+  for (const auto n : inside)
+  {
+    result.nInside += n;
+  }
+
+  result.seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  return result;
+}
+
+/// volume rendering of a field, resampled on the thread pool
+///
+/// The field is resampled when the zones, the field or the resolution
+/// change. Edits of the transfer function only replace its texture.
+struct volumeTool
+{
+  volumeSettings settings;
+  transferFunction transfer = transferFunction::ramp();
+  bool enabled = false;
+  float opacity = 1.0f;
+  /// ray marching steps per voxel
+  float quality = 2.0f;
+
+  /// call once per frame on the GL thread
+  void update(std::shared_ptr<const std::vector<structuredZone>> zones)
+  {
+    if (zones != _zones)
+    {
+      _zones = std::move(zones);
+      _texture.reset();
+      _shown.reset();
+
+      if (_zones && !_zones->empty() &&
+          !_zones->front().field(settings.field))
+      {
+        settings.field = _zones->front().fields.empty()
+                           ? std::string{}
+                           : _zones->front().fields.front().name;
+      }
+    }
+
+    if (_pending.valid() && _pending.wait_for(std::chrono::seconds(0)) ==
+                              std::future_status::ready)
+    {
+      auto result = _pending.get();
+
+      // results computed for previous zones are dropped
+      if (_pendingZones != _zones)
+      {
+        _pendingZones.reset();
+        return;
+      }
+      _pendingZones.reset();
+
+      _shown = result.settings;
+      _stats = { result.dims,
+                 result.n_samples(),
+                 result.nInside,
+                 result.seconds,
+                 result.samples_per_second() };
+
+      _texture.reset();
+      _uploaded.reset();
+      if (!result.values.empty())
+      {
+        const trace::scope traceScope{ "upload volume", "upload" };
+        _texture.emplace(result.values, result.dims, result.bounds);
+      }
+    }
+
+    if (_texture && _uploaded != transfer)
+    {
+      _texture->set_transfer_function(
+        transfer.table(volumeTexture::transfer_size));
+      _uploaded = transfer;
+    }
+
+    if (!enabled || !_zones || _pending.valid() || settings.field.empty())
+    {
+      return;
+    }
+
+    // the driver limits the texture size
+    auto request = settings;
+    request.resolution =
+      std::clamp<std::size_t>(request.resolution, 2, volumeTexture::max_size());
+    if (_shown && *_shown == request)
+    {
+      return;
+    }
+
+    _pendingZones = _zones;
+    _pending = default_pool().submit(
+      [zones = _zones, request]
+      { return resample_volume(*zones, request); });
+  }
+
+  /// ray march the volume, the rays end at the depth of the scene
+  void render(const shader& shader, const sceneDepth& scene)
+  {
+    if (enabled && _texture)
+    {
+      _texture->draw(shader, opacity, quality, scene);
+    }
+  }
+
+  /// statistics of the shown volume
+  struct stats
+  {
+    std::array<std::size_t, 3> dims{};
+    std::size_t nSamples = 0;
+    std::size_t nInside = 0;
+    double seconds = 0.0;
+    double samplesPerSecond = 0.0;
+  };
+
+  const stats& last_stats() const noexcept { return _stats; }
+
+  /// bytes of the volume and transfer function textures
+  std::size_t size_bytes() const noexcept
+  {
+    return _texture ? _texture->size_bytes() : 0;
+  }
+
+  bool busy() const noexcept { return _pending.valid(); }
+
+private:
+  std::shared_ptr<const std::vector<structuredZone>> _zones;
+  std::shared_ptr<const std::vector<structuredZone>> _pendingZones;
+  std::future<volumeResult> _pending;
+  std::optional<volumeSettings> _shown;
+  std::optional<volumeTexture> _texture;
+  /// transfer function of the texture
+  std::optional<transferFunction> _uploaded;
+  stats _stats;
+};
+
+} // namespace cgns_tools::gui
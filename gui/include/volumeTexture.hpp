@@ -0,0 +1,249 @@
+// Copyright (c) Pascal Post. All Rights Reserved.
+// Licensed under AGPLv3 license (see LICENSE.txt for details)
+
+#pragma once
+
+#include "helpers.hpp"
+#include "memory.hpp"
+#include "shader.hpp"
+#include "structuredZone.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+namespace cgns_tools::gui
+{
+
+/// depth of the opaque scene, rays through the volume end at it
+struct sceneDepth
+{
+  GLuint texture = 0;
+  glm::mat4 inverseViewProjection{ 1.0f };
+  /// size of the rendered region in pixels
+  glm::vec2 viewport{ 1.0f };
+};
+
+/// scalar volume on a regular grid as 3D texture, ray marched through its
+/// bounding box with a transfer function texture
+struct volumeTexture
+{
+  /// entries of the transfer function
+  static constexpr std::size_t transfer_size = 256;
+
+  /// constructor, values are x fastest with dims samples per direction, the
+  /// first and last samples lie on the bounds
+  volumeTexture(const std::vector<float>& values,
+                const std::array<std::size_t, 3>& dims,
+                const aabb& bounds)
+    : _dims{ dims }
+    , _bounds{ bounds }
+    , _volume{}
+    , _transfer{}
+    , _vao{}
+    , _gpu{ memory::category::gl_buffers,
+            sizeof(float) * (values.size() + 4 * transfer_size) }
+  {
+    opengl_fn<glGenTextures>(1, &_volume);
+    opengl_fn<glBindTexture>(GL_TEXTURE_3D, _volume);
+    opengl_fn<glPixelStorei>(GL_UNPACK_ALIGNMENT, 1);
+    opengl_fn<glTexImage3D>(GL_TEXTURE_3D,
+                            0,
+                            GL_R32F,
+                            GLsizei(dims[0]),
+                            GLsizei(dims[1]),
+                            GLsizei(dims[2]),
+                            0,
+                            GL_RED,
+                            GL_FLOAT,
+                            values.data());
+    opengl_fn<glPixelStorei>(GL_UNPACK_ALIGNMENT, 4);
+    set_parameters(GL_TEXTURE_3D);
+    opengl_fn<glTexParameteri>(
+      GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    opengl_fn<glGenTextures>(1, &_transfer);
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, _transfer);
+    opengl_fn<glTexImage2D>(GL_TEXTURE_2D,
+                            0,
+                            GL_RGBA32F,
+                            GLsizei(transfer_size),
+                            1,
+                            0,
+                            GL_RGBA,
+                            GL_FLOAT,
+                            nullptr);
+    set_parameters(GL_TEXTURE_2D);
+
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, 0);
+    opengl_fn<glBindTexture>(GL_TEXTURE_3D, 0);
+
+    // the box corners come from gl_VertexID, the core profile still needs a
+    // vertex array bound for drawing
+    opengl_fn<glGenVertexArrays>(1, &_vao);
+  }
+
+  /// destructor
+  ~volumeTexture() { delete_textures(); }
+
+  /// copy constructor
+  volumeTexture(const volumeTexture& other) = delete;
+
+  /// move constructor
+  volumeTexture(volumeTexture&& other) noexcept
+    : _dims{ other._dims }
+    , _bounds{ other._bounds }
+    , _volume{ std::exchange(other._volume, 0) }
+    , _transfer{ std::exchange(other._transfer, 0) }
+    , _vao{ std::exchange(other._vao, 0) }
+    , _gpu{ std::move(other._gpu) }
+  {
+  }
+
+  /// copy assignment
+  volumeTexture& operator=(const volumeTexture& other) = delete;
+
+  /// move assignment
+  volumeTexture& operator=(volumeTexture&& other) noexcept
+  {
+    std::swap(_dims, other._dims);
+    std::swap(_bounds, other._bounds);
+    std::swap(_volume, other._volume);
+    std::swap(_transfer, other._transfer);
+    std::swap(_vao, other._vao);
+    std::swap(_gpu, other._gpu);
+    return *this;
+  }
+
+  /// replace the transfer function, transfer_size rgba entries over the
+  /// normalized value
+  void set_transfer_function(const std::vector<float>& rgba)
+  {
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, _transfer);
+    opengl_fn<glTexSubImage2D>(GL_TEXTURE_2D,
+                               0,
+                               0,
+                               0,
+                               GLsizei(transfer_size),
+                               1,
+                               GL_RGBA,
+                               GL_FLOAT,
+                               rgba.data());
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, 0);
+  }
+
+  /// ray march the volume, quality is the number of samples per voxel
+  ///
+  /// The volume is composited over what was drawn before, call it after the
+  /// opaque geometry. Rays end at the scene depth, which is read from the
+  /// bound framebuffer: depth test and writes are off while drawing.
+  void draw(const shader& shader,
+            const float opacity,
+            const float quality,
+            const sceneDepth& scene)
+  {
+    const glm::vec3 extent = _bounds.max - _bounds.min;
+    const float voxelSize =
+      std::max({ extent.x / float(std::max<std::size_t>(_dims[0] - 1, 1)),
+                 extent.y / float(std::max<std::size_t>(_dims[1] - 1, 1)),
+                 extent.z / float(std::max<std::size_t>(_dims[2] - 1, 1)),
+                 1e-30f });
+
+    shader.use();
+    shader.set_i1(0, "volume");
+    shader.set_i1(1, "transferFunction");
+    shader.set_vec3(_bounds.min, "boxMin");
+    shader.set_vec3(_bounds.max, "boxMax");
+    shader.set_f1(voxelSize / std::max(quality, 0.1f), "stepSize");
+    shader.set_f1(voxelSize, "voxelSize");
+    shader.set_f1(opacity, "opacity");
+    shader.set_i1(2, "sceneDepth");
+    shader.set_mat4(scene.inverseViewProjection, "inverseViewProjection");
+    shader.set_vec2(scene.viewport, "viewport");
+
+    opengl_fn<glActiveTexture>(GL_TEXTURE0);
+    opengl_fn<glBindTexture>(GL_TEXTURE_3D, _volume);
+    opengl_fn<glActiveTexture>(GL_TEXTURE1);
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, _transfer);
+    opengl_fn<glActiveTexture>(GL_TEXTURE2);
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, scene.texture);
+
+    // back faces, the ray runs from the camera or the front face to them
+    opengl_fn<glDisable>(GL_DEPTH_TEST);
+    opengl_fn<glDepthMask>(GL_FALSE);
+    opengl_fn<glEnable>(GL_CULL_FACE);
+    opengl_fn<glCullFace>(GL_FRONT);
+    opengl_fn<glEnable>(GL_BLEND);
+    opengl_fn<glBlendFunc>(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    opengl_fn<glBindVertexArray>(_vao);
+    opengl_fn<glDrawArrays>(GL_TRIANGLES, 0, 36);
+    opengl_fn<glBindVertexArray>(0);
+
+    opengl_fn<glDisable>(GL_BLEND);
+    opengl_fn<glCullFace>(GL_BACK);
+    opengl_fn<glDisable>(GL_CULL_FACE);
+    opengl_fn<glDepthMask>(GL_TRUE);
+    opengl_fn<glEnable>(GL_DEPTH_TEST);
+
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, 0);
+    opengl_fn<glActiveTexture>(GL_TEXTURE1);
+    opengl_fn<glBindTexture>(GL_TEXTURE_2D, 0);
+    opengl_fn<glActiveTexture>(GL_TEXTURE0);
+    opengl_fn<glBindTexture>(GL_TEXTURE_3D, 0);
+  }
+
+  /// largest size per direction supported by the driver
+  static std::size_t max_size()
+  {
+    GLint size = 0;
+    opengl_fn<glGetIntegerv>(GL_MAX_3D_TEXTURE_SIZE, &size);
+    return std::size_t(std::max(size, 1));
+  }
+
+  const std::array<std::size_t, 3>& dims() const noexcept { return _dims; }
+
+  /// bytes of the textures
+  std::size_t size_bytes() const noexcept { return _gpu.bytes(); }
+
+private:
+  std::array<std::size_t, 3> _dims;
+  aabb _bounds;
+
+  GLuint _volume;
+  GLuint _transfer;
+  GLuint _vao;
+
+  memory::allocation _gpu;
+
+  static void set_parameters(const GLenum target)
+  {
+    opengl_fn<glTexParameteri>(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    opengl_fn<glTexParameteri>(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    opengl_fn<glTexParameteri>(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    opengl_fn<glTexParameteri>(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+
+  void delete_textures()
+  {
+    if (_volume)
+    {
+      opengl_fn<glDeleteTextures>(1, &_volume);
+    }
+
+    if (_transfer)
+    {
+      opengl_fn<glDeleteTextures>(1, &_transfer);
+    }
+
+    if (_vao)
+    {
+      opengl_fn<glDeleteVertexArrays>(1, &_vao);
+    }
+  }
+};
+
+} // namespace cgns_tools::gui
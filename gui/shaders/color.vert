@@ -0,0 +1,20 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+
+layout (std140) uniform Camera
+{
+   mat4 view;
+   mat4 projection;
+   mat4 viewProjection;
+   vec4 camPos;
+};
+
+out vec3 color;
+
+void main()
+{
+   color = aColor;
+   gl_Position = viewProjection * vec4(aPos, 1.0);
+}
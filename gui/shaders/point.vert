@@ -0,0 +1,16 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+layout (std140) uniform Camera
+{
+   mat4 view;
+   mat4 projection;
+   mat4 viewProjection;
+   vec4 camPos;
+};
+
+void main()
+{
+   gl_Position = viewProjection * vec4(aPos, 1.0);
+}
@@ -0,0 +1,83 @@
+#version 330 core
+
+// ray marching through the volume, drawn on the back faces of its bounding
+// box so that the camera may be inside
+
+in vec3 position;
+
+uniform sampler3D volume;           // normalized values, negative outside
+uniform sampler2D transferFunction; // rgba over the normalized value
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+uniform float stepSize;             // world units
+uniform float voxelSize;            // world units, opacities are per voxel
+uniform float opacity;              // scale of the transfer function opacity
+uniform sampler2D sceneDepth;       // depth of the opaque geometry
+uniform mat4 inverseViewProjection;
+uniform vec2 viewport;              // size of the rendered region in pixels
+
+layout (std140) uniform Camera
+{
+   mat4 view;
+   mat4 projection;
+   mat4 viewProjection;
+   vec4 camPos;
+};
+
+out vec4 FragColor;
+
+const int max_steps = 4096;
+
+void main()
+{
+   vec3 origin = camPos.xyz;
+   vec3 direction = normalize(position - origin);
+
+   // entry into the box, the exit is the fragment
+   vec3 t0 = (boxMin - origin) / direction;
+   vec3 t1 = (boxMax - origin) / direction;
+   vec3 tNear = min(t0, t1);
+   float tEnter = max(max(max(tNear.x, tNear.y), tNear.z), 0.0);
+   float tExit = length(position - origin);
+
+   // end at the opaque geometry in front of the exit
+   float depth = texelFetch(sceneDepth, ivec2(gl_FragCoord.xy), 0).r;
+   if (depth < 1.0)
+   {
+      vec4 ndc = vec4(2.0 * gl_FragCoord.xy / viewport - 1.0,
+                      2.0 * depth - 1.0,
+                      1.0);
+      vec4 scene = inverseViewProjection * ndc;
+      tExit = min(tExit, length(scene.xyz / scene.w - origin));
+   }
+
+   // texel centers of the samples at the box corners, flat bounds as in
+   // volume_dims
+   vec3 size = vec3(textureSize(volume, 0));
+   vec3 scale = (size - 1.0) / size / max(boxMax - boxMin, vec3(1e-30));
+   vec3 offset = 0.5 / size;
+
+   // start jittered per pixel against banding
+   float jitter = fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233))) *
+                        43758.5453);
+   float t = tEnter + jitter * stepSize;
+
+   vec4 result = vec4(0.0);
+   for (int i = 0; i < max_steps && t < tExit && result.a < 0.99; ++i)
+   {
+      vec3 x = origin + t * direction;
+      float v = texture(volume, (x - boxMin) * scale + offset).r;
+      if (v >= 0.0)
+      {
+         vec4 c = texture(transferFunction, vec2(v, 0.5));
+         float a = clamp(c.a * opacity, 0.0, 0.999);
+         a = 1.0 - pow(1.0 - a, stepSize / voxelSize);
+         result.rgb += (1.0 - result.a) * a * c.rgb;
+         result.a += (1.0 - result.a) * a;
+      }
+      t += stepSize;
+   }
+
+   // premultiplied alpha
+   FragColor = result;
+}
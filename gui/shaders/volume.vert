@@ -0,0 +1,33 @@
+#version 330 core
+
+// bounding box of the volume as 12 triangles without vertex attributes, the
+// corners follow from gl_VertexID
+
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+layout (std140) uniform Camera
+{
+   mat4 view;
+   mat4 projection;
+   mat4 viewProjection;
+   vec4 camPos;
+};
+
+out vec3 position;
+
+// corner c is at x = c & 1, y = c >> 1 & 1, z = c >> 2, counter-clockwise
+// seen from outside
+const int corners[36] = int[36](4, 6, 2, 4, 2, 0,
+                                1, 3, 7, 1, 7, 5,
+                                1, 5, 4, 1, 4, 0,
+                                2, 6, 7, 2, 7, 3,
+                                2, 3, 1, 2, 1, 0,
+                                4, 5, 7, 4, 7, 6);
+
+void main()
+{
+   int c = corners[gl_VertexID];
+   position = mix(boxMin, boxMax, vec3(c & 1, (c >> 1) & 1, c >> 2));
+   gl_Position = viewProjection * vec4(position, 1.0);
+}
@@ -0,0 +1,61 @@
+#version 330 core
+
+// grid lines of a structured zone without vertex attributes or indices: the
+// end points of each segment follow from gl_VertexID and the zone dimensions
+// and are fetched from the point buffer
+
+uniform samplerBuffer points; // xyz of the zone, or of all zones
+uniform bool packed;          // one point per texel, otherwise one float
+uniform int firstTexel;       // texel of the first point of the zone
+uniform ivec3 dims;           // points per direction
+uniform int direction;        // lines along i, j or k
+uniform int stride;           // every stride-th line is drawn
+uniform usamplerBuffer ranks; // buffer position of each point of the zone
+uniform bool reordered;       // points are not in i-j-k order, see ranks
+
+layout (std140) uniform Camera
+{
+   mat4 view;
+   mat4 projection;
+   mat4 viewProjection;
+   vec4 camPos;
+};
+
+void main()
+{
+   int u = (direction + 1) % 3;
+   int v = (direction + 2) % 3;
+
+   // lines at multiples of the stride and on the last index
+   int nSegments = dims[direction] - 1;
+   int nLinesU = (dims[u] + stride - 2) / stride + 1;
+
+   int segment = gl_VertexID / 2;
+   int line = segment / nSegments;
+
+   ivec3 ijk;
+   ijk[direction] = segment % nSegments + gl_VertexID % 2;
+   ijk[u] = min(line % nLinesU * stride, dims[u] - 1);
+   ijk[v] = min(line / nLinesU * stride, dims[v] - 1);
+
+   int point = ijk.x + dims.x * (ijk.y + dims.y * ijk.z);
+   if (reordered)
+   {
+      point = int(texelFetch(ranks, point).r);
+   }
+
+   vec3 p;
+   if (packed)
+   {
+      p = texelFetch(points, firstTexel + point).xyz;
+   }
+   else
+   {
+      int texel = firstTexel + 3 * point;
+      p = vec3(texelFetch(points, texel).r,
+               texelFetch(points, texel + 1).r,
+               texelFetch(points, texel + 2).r);
+   }
+
+   gl_Position = viewProjection * vec4(p, 1.0);
+}